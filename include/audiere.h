@@ -77,6 +77,17 @@
 
 namespace audiere {
 
+  /// 64-bit integers, signed for file offsets and frame positions and
+  /// unsigned for timestamps.
+#ifdef _MSC_VER
+  typedef signed __int64 s64;
+  typedef unsigned __int64 u64;
+#else
+  typedef signed long long s64;
+  typedef unsigned long long u64;
+#endif
+
+
   class RefCounted {
   protected:
     /**
@@ -244,6 +255,52 @@ namespace audiere {
      * @return  current position
      */
     ADR_METHOD(int) tell() = 0;
+
+    /**
+     * How a reader expects to access the file.  @see advise
+     */
+    enum AccessHint {
+      ACCESS_NORMAL,
+      ACCESS_SEQUENTIAL,
+      ACCESS_RANDOM,
+    };
+
+    /**
+     * Lends out the entire contents of the file if they are directly
+     * addressable, as with memory-mapped and memory files.  The pointer
+     * stays valid for the lifetime of the file object.
+     *
+     * @param data  set to the contents, or 0 if they aren't available
+     *
+     * @return  size of the contents in bytes, or 0
+     */
+    virtual s64 ADR_CALL getData(const void*& data) {
+      data = 0;
+      return 0;
+    }
+
+    /**
+     * Tells the file how it is about to be read, so that it can tune
+     * read-ahead.  This is only a hint and may be ignored.
+     */
+    ADR_METHOD(void) advise(AccessHint /*hint*/) { }
+
+    /**
+     * 64-bit version of seek().  The default implementation forwards to
+     * seek() and fails for positions that don't fit in an int.
+     */
+    ADR_METHOD(bool) seek64(s64 position, SeekMode mode) {
+      int p = int(position);
+      return (p == position ? seek(p, mode) : false);
+    }
+
+    /**
+     * 64-bit version of tell().  The default implementation forwards to
+     * tell().
+     */
+    virtual s64 ADR_CALL tell64() {
+      return tell();
+    }
   };
   typedef RefPtr<File> FilePtr;
 
@@ -376,6 +433,53 @@ namespace audiere {
      * it will be in the format <type>:<decoder>, so an example is: ogg:standard and mp3:mpaudec
      */
     virtual const char* ADR_CALL getDecoder() = 0;
+
+    /**
+     * Borrows up to frame_count already-decoded frames without copying
+     * them.  On success, block points at the frames, stored in the
+     * source's own format, and the number of frames available there is
+     * returned.  The position does not move until releaseBlock() is
+     * called, and block is only valid until then.
+     *
+     * Sources that cannot lend out their samples return 0.  So does a
+     * source that has nothing decoded at the moment, so when this returns
+     * 0, fall back to read(), which also handles repeating and the end of
+     * the stream.
+     *
+     * @param frame_count  maximum number of frames to borrow
+     * @param block        receives a pointer to the first borrowed frame
+     *
+     * @return  number of frames available at block, possibly 0
+     */
+    virtual int ADR_CALL acquireBlock(int /*frame_count*/, const void*& block) {
+      block = 0;
+      return 0;
+    }
+
+    /**
+     * Ends a borrow started with acquireBlock() and advances the source
+     * by frame_count frames, which must not exceed the number of frames
+     * acquireBlock() returned.
+     */
+    ADR_METHOD(void) releaseBlock(int /*frame_count*/) { }
+
+    /**
+     * 64-bit version of getLength().  Sources longer than 2^31 frames
+     * implement this, and getLength() returns INT_MAX for them.
+     */
+    virtual s64 ADR_CALL getLength64() {
+      return getLength();
+    }
+
+    /// 64-bit version of setPosition().
+    ADR_METHOD(void) setPosition64(s64 position) {
+      setPosition(position > 0x7FFFFFFF ? 0x7FFFFFFF : int(position));
+    }
+
+    /// 64-bit version of getPosition().
+    virtual s64 ADR_CALL getPosition64() {
+      return getPosition();
+    }
   };
   typedef RefPtr<SampleSource> SampleSourcePtr;
 
@@ -562,6 +666,49 @@ namespace audiere {
      * @return  current position in frames
      */
     ADR_METHOD(int) getPosition() = 0;
+
+    /// 64-bit version of getLength().  @see SampleSource::getLength64
+    virtual s64 ADR_CALL getLength64() {
+      return getLength();
+    }
+
+    /// 64-bit version of setPosition().
+    ADR_METHOD(void) setPosition64(s64 position) {
+      setPosition(position > 0x7FFFFFFF ? 0x7FFFFFFF : int(position));
+    }
+
+    /// 64-bit version of getPosition().
+    virtual s64 ADR_CALL getPosition64() {
+      return getPosition();
+    }
+
+    /**
+     * Decodes and converts the stream's first block of samples on the
+     * calling thread, so that starting it later only flips a flag and the
+     * device's first pass over the stream is a plain copy.  Call it on a
+     * stopped stream, e.g. right after opening it on a loading thread.
+     *
+     * Seeking or resetting the stream discards the primed samples.
+     *
+     * @return  true if the stream's first samples are ready to play
+     *          without decoding
+     */
+    ADR_METHOD(bool) prime() {
+      return false;
+    }
+
+    /**
+     * Gets the position, in frames of the stream's source, that is being
+     * heard right now.  getPosition() is ahead of it by what is buffered
+     * between the decoder and the speakers: resampling, mixing, and the
+     * device's output buffer.  Use this one to synchronize to the sound.
+     *
+     * The default implementation returns getPosition64(), for devices
+     * that don't know their latency.
+     */
+    virtual s64 ADR_CALL getPlayedPosition() {
+      return getPosition64();
+    }
   };
   typedef RefPtr<OutputStream> OutputStreamPtr;
 
@@ -569,6 +716,7 @@ namespace audiere {
   /// An integral code representing a specific type of event.
   enum EventType {
     ET_STOP, ///< See StopEvent and StopCallback
+    ET_LOAD, ///< See LoadEvent and LoadCallback
   };
 
 
@@ -666,6 +814,70 @@ namespace audiere {
   typedef RefPtr<StopCallback> StopCallbackPtr;
 
 
+  class SampleBuffer;
+
+
+  /**
+   * A copy of everything a device mixes, for recording or streaming the
+   * final mix.  The device's audio thread writes to it without ever
+   * waiting.  Frames that don't fit, because the tap wasn't read in
+   * time, are dropped and counted instead.  Only one thread at a time
+   * may read a tap.
+   *
+   * @see AudioDevice::openTap
+   */
+  class OutputTap : public RefCounted {
+  protected:
+    ~OutputTap() { }
+
+  public:
+    /**
+     * Retrieves the format of the frames in the tap.  Taps hold what
+     * the device mixes: 16-bit stereo at the device's sample rate.
+     */
+    ADR_METHOD(void) getFormat(
+      int& channel_count,
+      int& sample_rate,
+      SampleFormat& sample_format) = 0;
+
+    /**
+     * Reads up to frame_count frames of the mix into buffer.  Never
+     * waits for more.
+     *
+     * @return  number of frames read
+     */
+    ADR_METHOD(int) read(int frame_count, void* buffer) = 0;
+
+    /// Returns the number of frames waiting to be read.
+    ADR_METHOD(int) getAvailable() = 0;
+
+    /**
+     * Returns the number of times the device dropped frames because the
+     * tap was full.
+     */
+    ADR_METHOD(int) getOverflowCount() = 0;
+  };
+  typedef RefPtr<OutputTap> OutputTapPtr;
+
+
+  /**
+   * What a device measures about its mixing.  Devices leave what they
+   * don't measure 0.
+   * @see AudioDevice::getStats
+   */
+  struct DeviceStats {
+    s64 frames;           ///< frames mixed
+    int periods;          ///< periods mixed
+    int deadline_misses;  ///< periods finished after they were due to play
+    int period_time;      ///< length of a period in microseconds
+    s64 cpu_time;         ///< CPU time spent mixing in microseconds
+    int max_cpu_time;     ///< most CPU time spent on one period
+    int suspensions;      ///< times the output was suspended while idle
+    int restart_time;     ///< microseconds from play() to output resuming, last time
+    int max_restart_time; ///< longest restart_time
+  };
+
+
   /**
    * AudioDevice represents a device on the system which is capable
    * of opening and mixing multiple output streams.  In Windows,
@@ -751,6 +963,86 @@ namespace audiere {
 
     /// Clears all of the callbacks from the device.
     ADR_METHOD(void) clearCallbacks() = 0;
+
+    /**
+     * Open an output stream that plays the contents of a sample buffer.
+     * Unlike openBuffer(), devices that mix in software play straight
+     * from the buffer's memory instead of making their own copy.  The
+     * stream keeps a reference to the buffer.
+     *
+     * The default implementation passes the samples to openBuffer().
+     *
+     * @return  new output stream if successful, 0 if failure
+     */
+    virtual OutputStream* ADR_CALL openSampleBuffer(SampleBuffer* buffer);
+
+    /**
+     * Gets the rate, in frames per second, the device actually plays at.
+     * This may differ from the "rate" the device was asked for.
+     *
+     * @return sample rate, or 0 if the device doesn't know it
+     */
+    ADR_METHOD(int) getSampleRate() { return 0; }
+
+    /**
+     * Gets the length in frames of the periods the device writes to the
+     * hardware, as negotiated with the driver.  Together with
+     * getPeriodCount() and getSampleRate(), this gives the latency the
+     * device's buffering adds:
+     *
+     *   period_size * period_count / sample_rate  seconds
+     *
+     * @return period length, or 0 if the device doesn't know it
+     */
+    ADR_METHOD(int) getPeriodSize() { return 0; }
+
+    /**
+     * Gets the number of periods in the hardware buffer.
+     *
+     * @return period count, or 0 if the device doesn't know it
+     */
+    ADR_METHOD(int) getPeriodCount() { return 0; }
+
+    /**
+     * Gets the device's mixing statistics since it was opened.  Only
+     * devices that mix in software fill in stats, and only "virtual"
+     * measures the time mixing takes.
+     *
+     * @return true if stats was filled in
+     */
+    ADR_METHOD(bool) getStats(DeviceStats& /*stats*/) { return false; }
+
+    /**
+     * Gets how long, in frames at getSampleRate(), a frame mixed now
+     * takes to be heard.
+     *
+     * @return latency, or 0 if the device doesn't know it
+     */
+    ADR_METHOD(int) getLatency() { return 0; }
+
+    /**
+     * Gets the device's playback clock: how many frames it has played
+     * since it was opened, and when that was sampled, in microseconds
+     * on the GetMonotonicTime() clock.  Between queries, the frame count
+     * advances by getSampleRate() frames a second while anything plays.
+     *
+     * @return true if the device keeps a clock and frames and timestamp
+     *         were filled in
+     */
+    ADR_METHOD(bool) getClock(s64& /*frames*/, u64& /*timestamp*/) {
+      return false;
+    }
+
+    /**
+     * Opens a tap that receives everything the device mixes from now
+     * on.  The tap holds at least frame_count frames that haven't been
+     * read, and is removed from the device when its last reference goes
+     * away.  Only devices that mix in software support taps.  While a
+     * tap is open, the device doesn't suspend its output when idle.
+     *
+     * @return  new tap, or 0 if the device doesn't support taps
+     */
+    ADR_METHOD(OutputTap*) openTap(int /*frame_count*/) { return 0; }
   };
   typedef RefPtr<AudioDevice> AudioDevicePtr;
 
@@ -788,6 +1080,10 @@ namespace audiere {
      * Get a readonly pointer to the samples contained within the buffer.  The
      * buffer is |channel_count * frame_count * GetSampleSize(sample_format)|
      * bytes long.
+     *
+     * Compressed buffers have no such array and return 0.  Their samples
+     * can only be read through openStream().
+     * @see CreateCompressedSampleBuffer
      */
     virtual const void* ADR_CALL getSamples() = 0;
 
@@ -800,6 +1096,130 @@ namespace audiere {
   typedef RefPtr<SampleBuffer> SampleBufferPtr;
 
 
+  inline OutputStream* ADR_CALL
+  AudioDevice::openSampleBuffer(SampleBuffer* buffer) {
+    if (!buffer) {
+      return 0;
+    }
+
+    const void* samples = buffer->getSamples();
+    if (!samples) {
+      RefPtr<SampleSource> source(buffer->openStream());
+      return openStream(source.get());
+    }
+
+    int channel_count, sample_rate;
+    SampleFormat sample_format;
+    buffer->getFormat(channel_count, sample_rate, sample_format);
+    return openBuffer(
+      const_cast<void*>(samples), buffer->getLength(),
+      channel_count, sample_rate, sample_format);
+  }
+
+
+  /**
+   * A handle to an asset being loaded on Audiere's worker threads.  Use
+   * isDone() or wait() to find out when the load has finished, and then
+   * get the result that corresponds to the function that started it.
+   *
+   * @see OpenSampleSourceAsync, CreateSampleBufferAsync, OpenSoundAsync
+   */
+  class LoadRequest : public RefCounted {
+  protected:
+    ~LoadRequest() { }
+
+  public:
+    /// Returns the name of the file being loaded, or "" if there isn't one.
+    ADR_METHOD(const char*) getName() = 0;
+
+    /// Returns true once the load has finished, failed, or been cancelled.
+    ADR_METHOD(bool) isDone() = 0;
+
+    /**
+     * Blocks until the load is done or the timeout expires.
+     *
+     * @param milliseconds  Maximum time to wait.  Negative waits forever.
+     *
+     * @return  isDone()
+     */
+    ADR_METHOD(bool) wait(int milliseconds) = 0;
+
+    /**
+     * Cancels the load.  A load that hasn't started yet never runs, and
+     * the result of one that is already running is thrown away.
+     *
+     * @return  true if the request will not produce a result
+     */
+    ADR_METHOD(bool) cancel() = 0;
+
+    /// Returns true if cancel() took effect.
+    ADR_METHOD(bool) isCancelled() = 0;
+
+    /**
+     * Returns the time spent loading the asset in milliseconds, not
+     * counting time spent waiting in the queue.  0 until the load is done.
+     */
+    ADR_METHOD(int) getLoadTime() = 0;
+
+    /// Result of OpenSampleSourceAsync, or 0 if it failed or isn't done.
+    ADR_METHOD(SampleSource*) getSampleSource() = 0;
+
+    /// Result of CreateSampleBufferAsync, or 0 if it failed or isn't done.
+    ADR_METHOD(SampleBuffer*) getSampleBuffer() = 0;
+
+    /// Result of OpenSoundAsync, or 0 if it failed or isn't done.
+    ADR_METHOD(OutputStream*) getOutputStream() = 0;
+  };
+  typedef RefPtr<LoadRequest> LoadRequestPtr;
+
+
+  /**
+   * An event object that gets passed to implementations of LoadCallback
+   * when an asynchronous load has finished.
+   */
+  class LoadEvent : public Event {
+  protected:
+    ~LoadEvent() { }
+
+  public:
+    EventType ADR_CALL getType() { return ET_LOAD; }
+
+    /**
+     * @return Pointer to the request that finished.
+     */
+    ADR_METHOD(LoadRequest*) getRequest() = 0;
+  };
+  typedef RefPtr<LoadEvent> LoadEventPtr;
+
+
+  /**
+   * To be told when an asynchronous load finishes, implement this interface
+   * and pass it to one of the *Async functions.  Cancelled loads do not
+   * call it.
+   *
+   * WARNING: LoadCallback is called from one of Audiere's worker threads.
+   * Make sure your callback is thread-safe.
+   */
+  class LoadCallback : public Callback {
+  protected:
+    ~LoadCallback() { }
+
+  public:
+    EventType ADR_CALL getType() { return ET_LOAD; }
+    void ADR_CALL call(Event* event) {
+      loadCompleted(static_cast<LoadEvent*>(event));
+    }
+
+    /**
+     * Called when a load has finished, successfully or not.
+     *
+     * @param event  Information pertaining to the event.
+     */
+    ADR_METHOD(void) loadCompleted(LoadEvent* event) = 0;
+  };
+  typedef RefPtr<LoadCallback> LoadCallbackPtr;
+
+
   /**
    * Defines the type of SoundEffect objects.  @see SoundEffect
    */
@@ -809,6 +1229,17 @@ namespace audiere {
   };
 
 
+  /**
+   * What a MULTIPLE SoundEffect does when play() is called and all of its
+   * voices are playing.  @see SoundEffect::setVoicePolicy
+   */
+  enum VoicePolicy {
+    VOICE_STEAL_OLDEST,  ///< restart the voice that started longest ago
+    VOICE_DROP,          ///< ignore the play() call
+    VOICE_GROW,          ///< open another voice beyond the limit
+  };
+
+
   /**
    * SoundEffect is a convenience class which provides a simple
    * mechanism for basic sound playback.  There are two types of sound
@@ -873,6 +1304,27 @@ namespace audiere {
      * Get current pitch shift.  Defaults to 1.0.
      */
     ADR_METHOD(float) getPitchShift() = 0;
+
+    /**
+     * Sets how many instances of a MULTIPLE sound can play at once.
+     * Voices are opened as they are needed and reused once they stop.
+     * Lowering the limit below the number of open voices takes effect
+     * after the next stop().  Defaults to 16.  SINGLE sounds always
+     * have one voice.
+     */
+    ADR_METHOD(void) setVoiceLimit(int /*limit*/) { }
+
+    /// Returns the voice limit.  @see setVoiceLimit
+    ADR_METHOD(int) getVoiceLimit() { return 1; }
+
+    /**
+     * Sets what play() does when every voice is in use.  Defaults to
+     * VOICE_STEAL_OLDEST.  Has no effect on SINGLE sounds.
+     */
+    ADR_METHOD(void) setVoicePolicy(VoicePolicy /*policy*/) { }
+
+    /// Returns the voice policy.  @see setVoicePolicy
+    ADR_METHOD(VoicePolicy) getVoicePolicy() { return VOICE_STEAL_OLDEST; }
   };
   typedef RefPtr<SoundEffect> SoundEffectPtr;
 
@@ -1020,6 +1472,18 @@ namespace audiere {
   typedef RefPtr<MIDIDevice> MIDIDevicePtr;
 
 
+  /// Counters describing the process-wide SampleBuffer cache.
+  struct SampleCacheStats {
+    int hits;          ///< lookups served from the cache
+    int misses;        ///< lookups that had to decode the file
+    int evictions;     ///< unused buffers dropped to stay within budget
+    int entry_count;   ///< buffers currently cached
+    int pinned_count;  ///< cached buffers that are pinned
+    s64 bytes;         ///< sample memory held by cached buffers
+    s64 budget;        ///< @see SetSampleCacheBudget
+  };
+
+
   /// PRIVATE API - for internal use only
   namespace hidden {
 
@@ -1056,6 +1520,11 @@ namespace audiere {
       const char* name,
       const char* parameters);
 
+    ADR_FUNCTION(u64) AdrGetMonotonicTime();
+
+    ADR_FUNCTION(int) AdrGetEventDescriptor();
+    ADR_FUNCTION(int) AdrDispatchEvents();
+
     ADR_FUNCTION(SampleSource*) AdrOpenSampleSource(
       const char* filename,
       FileFormat file_format);
@@ -1074,6 +1543,9 @@ namespace audiere {
       AudioDevice* device,
       SampleSource* source,
       bool streaming);
+    ADR_FUNCTION(void) AdrSetHybridSoundPolicy(
+      int threshold_bytes,
+      int head_milliseconds);
 
     ADR_FUNCTION(SampleBuffer*) AdrCreateSampleBuffer(
       void* samples,
@@ -1081,21 +1553,84 @@ namespace audiere {
       int channel_count,
       int sample_rate,
       SampleFormat sample_format);
+    ADR_FUNCTION(SampleBuffer*) AdrCreateBorrowedSampleBuffer(
+      const void* samples,
+      int frame_count,
+      int channel_count,
+      int sample_rate,
+      SampleFormat sample_format,
+      RefCounted* owner);
     ADR_FUNCTION(SampleBuffer*) AdrCreateSampleBufferFromSource(
       SampleSource* source);
+    ADR_FUNCTION(SampleBuffer*) AdrCreateCompressedSampleBuffer(
+      SampleSource* source);
 
     ADR_FUNCTION(SoundEffect*) AdrOpenSoundEffect(
       AudioDevice* device,
       SampleSource* source,
       SoundEffectType type);
+    ADR_FUNCTION(SoundEffect*) AdrOpenSoundEffectFromBuffer(
+      AudioDevice* device,
+      SampleBuffer* buffer,
+      SoundEffectType type);
+
+    // The returned buffer carries a reference owned by the caller.
+    ADR_FUNCTION(SampleBuffer*) AdrGetCachedSampleBuffer(
+      const char* filename,
+      FileFormat file_format);
+    ADR_FUNCTION(bool) AdrPinCachedSampleBuffer(
+      const char* filename,
+      FileFormat file_format,
+      bool pinned);
+    ADR_FUNCTION(void) AdrSetSampleCacheBudget(s64 bytes);
+    ADR_FUNCTION(void) AdrGetSampleCacheStats(SampleCacheStats* stats);
+    ADR_FUNCTION(void) AdrFlushSampleCache();
+    ADR_FUNCTION(void) AdrSetSampleCacheCompression(bool compressed);
 
     ADR_FUNCTION(File*) AdrOpenFile(
       const char* name,
       bool writeable);
 
+    ADR_FUNCTION(File*) AdrOpenMappedFile(
+      const char* name);
+
+    ADR_FUNCTION(File*) AdrOpenPrefetchFile(
+      File* file,
+      int block_size);
+
     ADR_FUNCTION(File*) AdrCreateMemoryFile(
       const void* buffer,
       int size);
+    ADR_FUNCTION(File*) AdrCreateBorrowedMemoryFile(
+      const void* buffer,
+      int size,
+      RefCounted* owner);
+
+    // The returned requests carry a reference owned by the caller.
+    ADR_FUNCTION(LoadRequest*) AdrOpenSampleSourceAsync(
+      const char* filename,
+      FileFormat file_format,
+      Callback* callback);
+    ADR_FUNCTION(LoadRequest*) AdrOpenSampleSourceFromFileAsync(
+      File* file,
+      FileFormat file_format,
+      Callback* callback);
+    ADR_FUNCTION(LoadRequest*) AdrCreateSampleBufferAsync(
+      const char* filename,
+      FileFormat file_format,
+      Callback* callback);
+    ADR_FUNCTION(void) AdrCreateSampleBuffersAsync(
+      const char** filenames,
+      int count,
+      FileFormat file_format,
+      Callback* callback,
+      LoadRequest** requests);
+    ADR_FUNCTION(LoadRequest*) AdrOpenSoundAsync(
+      AudioDevice* device,
+      const char* filename,
+      bool streaming,
+      FileFormat file_format,
+      Callback* callback);
 
     ADR_FUNCTION(const char*) AdrEnumerateCDDevices();
 
@@ -1235,6 +1770,45 @@ namespace audiere {
     return hidden::AdrOpenDevice(name, parameters);
   }
 
+  /**
+   * Returns the time in microseconds on a clock that only moves forward,
+   * e.g. unaffected by setting the system time.  Only the differences
+   * between its values mean anything.
+   *
+   * @see AudioDevice::getClock
+   */
+  inline u64 GetMonotonicTime() {
+    return hidden::AdrGetMonotonicTime();
+  }
+
+  /**
+   * Hands the calling of device callbacks, e.g. StopCallback, to the
+   * application.  Normally a thread of Audiere's calls them.  After this,
+   * they are only called from DispatchEvents(), and the returned
+   * descriptor polls readable while events are waiting for it, so they
+   * can be handled on the application's own event loop.  Events that
+   * aren't dispatched pile up, and once enough have, new ones are lost.
+   *
+   * This can't be undone, and affects all devices in the process.
+   *
+   * @return  descriptor to poll for reading, or -1 if the platform has
+   *          none, in which case callbacks stay on Audiere's thread
+   */
+  inline int GetEventDescriptor() {
+    return hidden::AdrGetEventDescriptor();
+  }
+
+  /**
+   * Calls the callbacks for waiting events on the calling thread, once
+   * GetEventDescriptor() has handed them to the application.  Don't call
+   * it from a callback.
+   *
+   * @return  number of events dispatched
+   */
+  inline int DispatchEvents() {
+    return hidden::AdrDispatchEvents();
+  }
+
   /**
    * Create a streaming sample source from a sound file.  This factory simply
    * opens a default file from the system filesystem and calls
@@ -1362,7 +1936,9 @@ namespace audiere {
    *
    * @param streaming  If false or unspecified, OpenSound attempts to
    *                   open the entire sound into memory.  Otherwise, it
-   *                   streams the sound from the file.
+   *                   streams the sound from the file.  Sounds larger
+   *                   than the hybrid threshold only have their beginning
+   *                   loaded into memory.  @see SetHybridSoundPolicy
    *
    * @return  new output stream if successful, 0 otherwise
    */
@@ -1374,6 +1950,20 @@ namespace audiere {
     return hidden::AdrOpenSound(device.get(), source.get(), streaming);
   }
 
+  /**
+   * Sets how OpenSound(device, source, false) loads long sounds.  Sounds
+   * whose decoded samples would take more than threshold_bytes aren't
+   * decoded into memory as a whole.  Instead, their first
+   * head_milliseconds are decoded when the sound is opened and play
+   * immediately, while the rest is decoded in the background a little
+   * ahead of playback.  A threshold of 0 or less turns this off.
+   *
+   * The defaults are 2 MB and 500 milliseconds.
+   */
+  inline void SetHybridSoundPolicy(int threshold_bytes, int head_milliseconds) {
+    hidden::AdrSetHybridSoundPolicy(threshold_bytes, head_milliseconds);
+  }
+
   /**
    * Calls OpenSound(AudioDevice*, SampleSource*) with a sample source
    * created via OpenSampleSource(const char*).
@@ -1431,6 +2021,38 @@ namespace audiere {
       channel_count, sample_rate, sample_format);
   }
 
+  /**
+   * Create a SampleBuffer object that plays the caller's samples in place
+   * instead of copying them.  The samples must stay valid for as long as
+   * the buffer, or any stream opened from it, exists.
+   *
+   * To hand ownership of the samples to the buffer, pass an owner object
+   * that frees them in its destructor.  The buffer holds a reference to
+   * the owner and releases it when the buffer is destroyed.
+   *
+   * @param samples        Sample data in the given format.
+   * @param frame_count    Number of frames in the data.
+   * @param channel_count  Number of channels in each frame.
+   * @param sample_rate    Sample rate in Hz.
+   * @param sample_format  Format of each sample.  @see SampleFormat.
+   * @param owner          Object keeping the samples alive, or 0.
+   *
+   * @return  new SampleBuffer object, or 0 if samples is null
+   */
+  inline SampleBuffer* CreateBorrowedSampleBuffer(
+    const void* samples,
+    int frame_count,
+    int channel_count,
+    int sample_rate,
+    SampleFormat sample_format,
+    RefCounted* owner = 0)
+  {
+    return hidden::AdrCreateBorrowedSampleBuffer(
+      samples, frame_count,
+      channel_count, sample_rate, sample_format,
+      owner);
+  }
+
   /**
    * Create a SampleBuffer object from a SampleSource.
    *
@@ -1444,6 +2066,24 @@ namespace audiere {
     return hidden::AdrCreateSampleBufferFromSource(source.get());
   }
 
+  /**
+   * Create a SampleBuffer that keeps the source's samples IMA ADPCM
+   * compressed, in a quarter of the memory 16-bit samples would take.
+   * The buffer plays as 16-bit samples and is decoded a block at a time
+   * while it plays.  getSamples() returns 0 for such buffers.
+   *
+   * ADPCM is lossy.  It suits sound effects far better than music.
+   *
+   * @param source  Seekable sample source used to create the buffer.
+   *
+   * @return  new sample buffer if success, 0 otherwise
+   */
+  inline SampleBuffer* CreateCompressedSampleBuffer(
+    const SampleSourcePtr& source)
+  {
+    return hidden::AdrCreateCompressedSampleBuffer(source.get());
+  }
+
   /**
    * Open a SoundEffect object from the given sample source and sound
    * effect type.  @see SoundEffect
@@ -1496,6 +2136,7 @@ namespace audiere {
 
   /**
    * Opens a default file implementation from the local filesystem.
+   * Read-only files are memory-mapped when possible.
    *
    * @param filename   The name of the file on the local filesystem.
    * @param writeable  Whether the writing to the file is allowed.
@@ -1504,6 +2145,37 @@ namespace audiere {
     return hidden::AdrOpenFile(filename, writeable);
   }
 
+  /**
+   * Opens a read-only file from the local filesystem by mapping it into
+   * memory.  Its contents are available through File::getData().
+   *
+   * @param filename  The name of the file on the local filesystem.
+   *
+   * @return  0 if the file can't be opened or mapped, for example
+   *          because it is empty or not a regular file
+   */
+  inline File* OpenMappedFile(const char* filename) {
+    return hidden::AdrOpenMappedFile(filename);
+  }
+
+  /**
+   * Wraps a file so that reads are served from blocks that the library's
+   * I/O thread reads ahead of time.  Reads from all prefetching files are
+   * batched and issued in file order, which keeps many streaming sounds
+   * from stalling on the disk.  Files whose contents are already in
+   * memory are returned as they are.
+   *
+   * The wrapper reads from the original file on another thread, so the
+   * original must not be used directly afterwards.
+   *
+   * @param file        The file to read ahead from.
+   * @param block_size  Size of each read-ahead block in bytes, or 0 for
+   *                    the default of 64 KB.
+   */
+  inline File* OpenPrefetchFile(File* file, int block_size = 0) {
+    return hidden::AdrOpenPrefetchFile(file, block_size);
+  }
+
   /**
    * Creates a File implementation that reads from a buffer in memory.
    * It stores a copy of the buffer that is passed in.
@@ -1521,6 +2193,239 @@ namespace audiere {
     return hidden::AdrCreateMemoryFile(buffer, size);
   }
 
+  /**
+   * Creates a File implementation that reads directly from a buffer in
+   * memory without copying it.  The buffer is only copied if the file is
+   * written to.
+   *
+   * Without an owner, the caller must keep the buffer alive for as long
+   * as the file, or anything opened from it, exists.  With an owner, the
+   * file holds a reference to the owner instead.  For example, slices of
+   * a packed asset file can be opened by passing the File returned by
+   * OpenMappedFile as the owner of pointers into its getData() contents.
+   *
+   * @param buffer  Pointer to the beginning of the data.
+   * @param size    Size of the buffer in bytes.
+   * @param owner   Object keeping the buffer alive, or 0.
+   *
+   * @return  0 if size is non-zero and buffer is null. Otherwise,
+   *          returns a valid File object.
+   */
+  inline File* CreateBorrowedMemoryFile(
+    const void* buffer,
+    int size,
+    RefCounted* owner = 0)
+  {
+    return hidden::AdrCreateBorrowedMemoryFile(buffer, size, owner);
+  }
+
+  /// Wraps a request returned by a hidden *Async function.
+  inline LoadRequestPtr AdoptLoadRequest(LoadRequest* request) {
+    LoadRequestPtr ptr(request);
+    if (request) {
+      request->unref();
+    }
+    return ptr;
+  }
+
+  /**
+   * Starts opening a sample source on Audiere's worker threads and returns
+   * immediately.  When the request is done, getSampleSource() holds what
+   * OpenSampleSource(filename, file_format) would have returned.
+   *
+   * @param callback  Optional LoadCallback called when the load finishes.
+   */
+  inline LoadRequestPtr OpenSampleSourceAsync(
+    const char* filename,
+    FileFormat file_format = FF_AUTODETECT,
+    Callback* callback = 0)
+  {
+    return AdoptLoadRequest(
+      hidden::AdrOpenSampleSourceAsync(filename, file_format, callback));
+  }
+
+  /**
+   * Like OpenSampleSourceAsync(const char*), but decodes from a file
+   * object.  The file must not be used elsewhere until the load is done.
+   */
+  inline LoadRequestPtr OpenSampleSourceAsync(
+    const FilePtr& file,
+    FileFormat file_format = FF_AUTODETECT,
+    Callback* callback = 0)
+  {
+    return AdoptLoadRequest(hidden::AdrOpenSampleSourceFromFileAsync(
+      file.get(), file_format, callback));
+  }
+
+  /**
+   * Starts decoding a whole file into a SampleBuffer on Audiere's worker
+   * threads and returns immediately.  When the request is done,
+   * getSampleBuffer() holds the result.
+   *
+   * @param callback  Optional LoadCallback called when the load finishes.
+   */
+  inline LoadRequestPtr CreateSampleBufferAsync(
+    const char* filename,
+    FileFormat file_format = FF_AUTODETECT,
+    Callback* callback = 0)
+  {
+    return AdoptLoadRequest(
+      hidden::AdrCreateSampleBufferAsync(filename, file_format, callback));
+  }
+
+  /**
+   * Queues a SampleBuffer load for each file in one submission.  The
+   * requests are appended to 'requests' in the same order as the files.
+   */
+  inline void CreateSampleBuffersAsync(
+    const std::vector<std::string>& filenames,
+    std::vector<LoadRequestPtr>& requests,
+    FileFormat file_format = FF_AUTODETECT,
+    Callback* callback = 0)
+  {
+    if (filenames.empty()) {
+      return;
+    }
+
+    std::vector<const char*> names(filenames.size());
+    for (size_t i = 0; i < filenames.size(); ++i) {
+      names[i] = filenames[i].c_str();
+    }
+
+    std::vector<LoadRequest*> raw(filenames.size());
+    hidden::AdrCreateSampleBuffersAsync(
+      &names[0], int(names.size()), file_format, callback, &raw[0]);
+    for (size_t i = 0; i < raw.size(); ++i) {
+      requests.push_back(AdoptLoadRequest(raw[i]));
+    }
+  }
+
+  /**
+   * Starts OpenSound(device, filename, streaming, file_format) on
+   * Audiere's worker threads and returns immediately.  When the request
+   * is done, getOutputStream() holds the result.
+   *
+   * @param callback  Optional LoadCallback called when the load finishes.
+   */
+  inline LoadRequestPtr OpenSoundAsync(
+    const AudioDevicePtr& device,
+    const char* filename,
+    bool streaming = false,
+    FileFormat file_format = FF_AUTODETECT,
+    Callback* callback = 0)
+  {
+    return AdoptLoadRequest(hidden::AdrOpenSoundAsync(
+      device.get(), filename, streaming, file_format, callback));
+  }
+
+  /// Cancels every request in the list.  @see LoadRequest::cancel
+  inline void CancelLoadRequests(const std::vector<LoadRequestPtr>& requests) {
+    for (size_t i = 0; i < requests.size(); ++i) {
+      if (requests[i]) {
+        requests[i]->cancel();
+      }
+    }
+  }
+
+  /**
+   * Returns the SampleBuffer for a file from the process-wide cache,
+   * decoding it on the first request.  The cache is keyed by filename and
+   * file format and is shared by every device.
+   *
+   * Buffers stay cached while anything references them.  Once unused,
+   * they are kept in least-recently-used order and dropped when the
+   * cache's total size exceeds its budget.  @see SetSampleCacheBudget
+   *
+   * @return  the cached buffer, or 0 if the file can't be decoded
+   */
+  inline SampleBufferPtr GetCachedSampleBuffer(
+    const char* filename,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    SampleBuffer* buffer =
+      hidden::AdrGetCachedSampleBuffer(filename, file_format);
+    SampleBufferPtr ptr(buffer);
+    if (buffer) {
+      buffer->unref();
+    }
+    return ptr;
+  }
+
+  /**
+   * Pins or unpins a file in the sample cache.  Pinned buffers are never
+   * evicted.  Pinning a file that isn't cached yet decodes it.
+   *
+   * @return  false if the file couldn't be decoded, or if it is being
+   *          unpinned and isn't cached
+   */
+  inline bool PinCachedSampleBuffer(
+    const char* filename,
+    bool pinned = true,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    return hidden::AdrPinCachedSampleBuffer(filename, file_format, pinned);
+  }
+
+  /**
+   * Sets how many bytes of samples the cache may hold before it evicts
+   * unused, unpinned buffers.  Buffers in use are never evicted, so the
+   * cache can exceed its budget.  The default is 32 MB.
+   */
+  inline void SetSampleCacheBudget(s64 bytes) {
+    hidden::AdrSetSampleCacheBudget(bytes);
+  }
+
+  inline SampleCacheStats GetSampleCacheStats() {
+    SampleCacheStats stats;
+    hidden::AdrGetSampleCacheStats(&stats);
+    return stats;
+  }
+
+  /// Evicts every unused, unpinned buffer from the cache.
+  inline void FlushSampleCache() {
+    hidden::AdrFlushSampleCache();
+  }
+
+  /**
+   * Makes the cache store the files it decodes from now on as compressed
+   * buffers.  Buffers already cached keep their format.  Off by default.
+   * @see CreateCompressedSampleBuffer
+   */
+  inline void SetSampleCacheCompression(bool compressed) {
+    hidden::AdrSetSampleCacheCompression(compressed);
+  }
+
+  /**
+   * Like OpenSound(device, filename, false, file_format), but plays the
+   * file's cached SampleBuffer.  Repeated calls decode the file once.
+   */
+  inline OutputStream* OpenCachedSound(
+    const AudioDevicePtr& device,
+    const char* filename,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    if (!device) {
+      return 0;
+    }
+    SampleBufferPtr buffer = GetCachedSampleBuffer(filename, file_format);
+    return (buffer ? device->openSampleBuffer(buffer.get()) : 0);
+  }
+
+  /**
+   * Like OpenSoundEffect(device, filename, type, file_format), but plays
+   * the file's cached SampleBuffer.
+   */
+  inline SoundEffect* OpenCachedSoundEffect(
+    const AudioDevicePtr& device,
+    const char* filename,
+    SoundEffectType type,
+    FileFormat file_format = FF_AUTODETECT)
+  {
+    SampleBufferPtr buffer = GetCachedSampleBuffer(filename, file_format);
+    return hidden::AdrOpenSoundEffectFromBuffer(
+      device.get(), buffer.get(), type);
+  }
+
   /**
    * Generates a list of available CD device names.
    *
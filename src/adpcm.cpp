@@ -0,0 +1,240 @@
+#include <string.h>
+#include "adpcm.h"
+#include "utility.h"
+
+
+namespace audiere {
+
+  const AdpcmCoefficients MS_ADPCM_COEFFICIENTS[7] = {
+    { 256,    0 },
+    { 512, -256 },
+    {   0,    0 },
+    { 192,   64 },
+    { 240,    0 },
+    { 460, -208 },
+    { 392, -232 },
+  };
+
+
+  static const int IMA_STEP_TABLE[89] = {
+        7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+       19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+       50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+     2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+     5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+  };
+
+  static const int IMA_INDEX_TABLE[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8,
+  };
+
+  static const int MS_ADAPTATION_TABLE[16] = {
+    230, 230, 230, 230, 307, 409, 512, 614,
+    768, 614, 512, 409, 307, 230, 230, 230,
+  };
+
+
+  /// State of one channel of an IMA ADPCM stream.
+  struct ImaChannel {
+    int predictor;
+    int index;
+
+    s16 decode(int nibble) {
+      const int step = IMA_STEP_TABLE[index];
+      int diff = step >> 3;
+      if (nibble & 1) diff += step >> 2;
+      if (nibble & 2) diff += step >> 1;
+      if (nibble & 4) diff += step;
+      if (nibble & 8) {
+        predictor -= diff;
+      } else {
+        predictor += diff;
+      }
+      predictor = clamp(-32768, predictor, 32767);
+      index     = clamp(0, index + IMA_INDEX_TABLE[nibble], 88);
+      return s16(predictor);
+    }
+
+    /// Returns the nibble that best approximates sample, and decodes it.
+    int encode(int sample) {
+      const int step = IMA_STEP_TABLE[index];
+      int diff = sample - predictor;
+      int nibble = 0;
+      if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+      }
+      if (diff >= step)      { nibble |= 4; diff -= step;      }
+      if (diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+      if (diff >= step >> 2) { nibble |= 1;                    }
+
+      // keep the encoder's state exactly where the decoder's will be
+      decode(nibble);
+      return nibble;
+    }
+  };
+
+
+  int GetImaFramesPerBlock(int block_size, int channel_count) {
+    const int header_size = 4 * channel_count;
+    if (channel_count <= 0 || block_size < header_size) {
+      return 0;
+    }
+    // the header holds the first frame, then 8 frames per 4 bytes/channel
+    return (block_size - header_size) / (4 * channel_count) * 8 + 1;
+  }
+
+
+  int GetMsFramesPerBlock(int block_size, int channel_count) {
+    const int header_size = 7 * channel_count;
+    if (channel_count <= 0 || block_size < header_size) {
+      return 0;
+    }
+    // the header holds the first two frames, then a nibble per sample
+    return (block_size - header_size) * 2 / channel_count + 2;
+  }
+
+
+  bool DecodeImaBlock(
+    const u8* block, int channel_count, int frame_count, s16* out)
+  {
+    if (channel_count > ADPCM_MAX_CHANNELS) {
+      return false;
+    }
+    if (frame_count <= 0) {
+      return true;
+    }
+
+    ImaChannel state[ADPCM_MAX_CHANNELS];
+    for (int c = 0; c < channel_count; ++c) {
+      ImaChannel& channel = state[c];
+      channel.predictor = s16(read16_le(block + c * 4));
+      channel.index     = clamp(0, int(block[c * 4 + 2]), 88);
+      out[c] = s16(channel.predictor);
+    }
+
+    // Each channel's samples come in runs of 8 nibbles (4 bytes), low
+    // nibble first, with the channels' runs interleaved.
+    const u8* data = block + channel_count * 4;
+    for (int frame = 1; frame < frame_count; frame += 8) {
+      const int run = std::min(8, frame_count - frame);
+      for (int c = 0; c < channel_count; ++c) {
+        ImaChannel channel = state[c];
+        s16* o = out + frame * channel_count + c;
+        for (int i = 0; i < run; ++i) {
+          const int nibble = (data[i >> 1] >> ((i & 1) * 4)) & 0xF;
+          *o = channel.decode(nibble);
+          o += channel_count;
+        }
+        state[c] = channel;
+        data += 4;
+      }
+    }
+    return true;
+  }
+
+
+  bool DecodeMsBlock(
+    const u8* block, int channel_count, int frame_count, s16* out,
+    const AdpcmCoefficients* coefficients, int coefficient_count)
+  {
+    if (channel_count > ADPCM_MAX_CHANNELS) {
+      return false;
+    }
+    if (frame_count <= 0) {
+      return true;
+    }
+
+    int coef1[ADPCM_MAX_CHANNELS], coef2[ADPCM_MAX_CHANNELS];
+    int delta[ADPCM_MAX_CHANNELS];
+    int sample1[ADPCM_MAX_CHANNELS], sample2[ADPCM_MAX_CHANNELS];
+    const u8* p = block;
+    for (int c = 0; c < channel_count; ++c, ++p) {
+      if (*p >= coefficient_count) {
+        return false;
+      }
+      coef1[c] = coefficients[*p].coef1;
+      coef2[c] = coefficients[*p].coef2;
+    }
+    for (int c = 0; c < channel_count; ++c, p += 2) {
+      delta[c] = s16(read16_le(p));
+    }
+    for (int c = 0; c < channel_count; ++c, p += 2) {
+      sample1[c] = s16(read16_le(p));
+    }
+    for (int c = 0; c < channel_count; ++c, p += 2) {
+      sample2[c] = s16(read16_le(p));
+    }
+
+    // the header stores the two starting frames latest first
+    for (int c = 0; c < channel_count; ++c) {
+      out[c] = s16(sample2[c]);
+      if (frame_count > 1) {
+        out[channel_count + c] = s16(sample1[c]);
+      }
+    }
+
+    // one nibble per sample, high nibble first, channels interleaved
+    const int sample_count = (frame_count - 2) * channel_count;
+    s16* o = out + 2 * channel_count;
+    int c = 0;
+    for (int i = 0; i < sample_count; ++i) {
+      const int raw = (i & 1) ? (p[i >> 1] & 0xF) : (p[i >> 1] >> 4);
+      const int nibble = (raw & 8) ? raw - 16 : raw;
+
+      int predictor = (sample1[c] * coef1[c] + sample2[c] * coef2[c]) >> 8;
+      predictor = clamp(-32768, predictor + nibble * delta[c], 32767);
+      *o++ = s16(predictor);
+
+      sample2[c] = sample1[c];
+      sample1[c] = predictor;
+      delta[c] = std::max(16, (MS_ADAPTATION_TABLE[raw] * delta[c]) >> 8);
+
+      if (++c == channel_count) {
+        c = 0;
+      }
+    }
+    return true;
+  }
+
+
+  void EncodeImaBlock(
+    const s16* in, int frame_count, int channel_count,
+    int block_size, u8* block, int* step_index)
+  {
+    const int frames_per_block = GetImaFramesPerBlock(block_size, channel_count);
+    memset(block, 0, block_size);
+    if (frame_count <= 0) {
+      return;
+    }
+
+    for (int c = 0; c < channel_count; ++c) {
+      ImaChannel channel;
+      channel.predictor = in[c];
+      channel.index     = clamp(0, step_index[c], 88);
+
+      u8* header = block + c * 4;
+      header[0] = u8(channel.predictor & 0xFF);
+      header[1] = u8((channel.predictor >> 8) & 0xFF);
+      header[2] = u8(channel.index);
+
+      u8* data = block + channel_count * 4 + c * 4;
+      for (int frame = 1; frame < frames_per_block; frame += 8) {
+        for (int i = 0; i < 8; ++i) {
+          const int f = std::min(frame + i, frame_count - 1);
+          const int nibble = channel.encode(in[f * channel_count + c]);
+          data[i >> 1] |= u8(nibble << ((i & 1) * 4));
+        }
+        data += channel_count * 4;
+      }
+
+      step_index[c] = channel.index;
+    }
+  }
+
+}
@@ -0,0 +1,70 @@
+/**
+ * @file
+ *
+ * IMA and Microsoft ADPCM block codecs, in the block layouts used by
+ * WAV files (format tags 0x0011 and 0x0002).
+ */
+
+#ifndef ADPCM_H
+#define ADPCM_H
+
+
+#include "types.h"
+
+
+namespace audiere {
+
+  enum {
+    WAVE_FORMAT_ADPCM     = 0x0002,  ///< Microsoft ADPCM
+    WAVE_FORMAT_IMA_ADPCM = 0x0011,
+
+    ADPCM_MAX_CHANNELS = 8,
+  };
+
+  /// A Microsoft ADPCM predictor coefficient pair.
+  struct AdpcmCoefficients {
+    s16 coef1;
+    s16 coef2;
+  };
+
+  /// The seven predictors every Microsoft ADPCM file starts with.
+  extern const AdpcmCoefficients MS_ADPCM_COEFFICIENTS[7];
+
+
+  /// Number of frames in an IMA ADPCM block, or 0 if the block is too small.
+  int GetImaFramesPerBlock(int block_size, int channel_count);
+
+  /// Number of frames in an MS ADPCM block, or 0 if the block is too small.
+  int GetMsFramesPerBlock(int block_size, int channel_count);
+
+  /**
+   * Decodes the first frame_count frames of an IMA ADPCM block into
+   * interleaved 16-bit samples.  frame_count must not exceed the block's
+   * frames per block.  Returns false if there are too many channels.
+   */
+  bool DecodeImaBlock(
+    const u8* block, int channel_count, int frame_count, s16* out);
+
+  /**
+   * Decodes the first frame_count frames of an MS ADPCM block.  Returns
+   * false if there are too many channels or the block refers to a
+   * predictor that isn't in coefficients.
+   */
+  bool DecodeMsBlock(
+    const u8* block, int channel_count, int frame_count, s16* out,
+    const AdpcmCoefficients* coefficients, int coefficient_count);
+
+  /**
+   * Encodes up to a block's worth of interleaved 16-bit frames as an IMA
+   * ADPCM block of block_size bytes.  A short final block is padded by
+   * repeating its last frame.  step_index holds each channel's step index,
+   * carried from one block to the next; start every channel at 0.
+   */
+  void EncodeImaBlock(
+    const s16* in, int frame_count, int channel_count,
+    int block_size, u8* block, int* step_index);
+
+}
+
+
+#endif
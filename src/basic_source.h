@@ -5,6 +5,7 @@
 #include <vector>
 #include <string>
 #include "audiere.h"
+#include "utility.h"
 
 
 namespace audiere {
@@ -24,7 +25,8 @@ namespace audiere {
   /**
    * Basic implementation of a sample source including things such as
    * repeat.  BasicSource also defines the required methods for unseekable
-   * sources.  Override them if you can seek.
+   * sources.  Override the 64-bit ones if you can seek; the int versions
+   * forward to them.
    */
   class BasicSource : public RefImplementation<SampleSource> {
   public:
@@ -37,9 +39,13 @@ namespace audiere {
     int ADR_CALL read(int frame_count, void* buffer);
 
     bool ADR_CALL isSeekable()                  { return false; }
-    int  ADR_CALL getLength()                   { return 0;     }
-    void ADR_CALL setPosition(int /*position*/) {               }
-    int  ADR_CALL getPosition()                 { return 0;     }
+    int  ADR_CALL getLength()         { return ClampToInt(getLength64());   }
+    void ADR_CALL setPosition(int position)     { setPosition64(position); }
+    int  ADR_CALL getPosition()       { return ClampToInt(getPosition64()); }
+
+    s64  ADR_CALL getLength64()                   { return 0; }
+    void ADR_CALL setPosition64(s64 /*position*/) {           }
+    s64  ADR_CALL getPosition64()                 { return 0; }
 
     bool ADR_CALL getRepeat()                   { return m_repeat; }
     void ADR_CALL setRepeat(bool repeat)        { m_repeat = repeat; }
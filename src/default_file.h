@@ -9,6 +9,7 @@
 namespace audiere {
 
   ADR_EXPORT(File*) AdrOpenFile(const char* filename, bool writeable);
+  ADR_EXPORT(File*) AdrOpenMappedFile(const char* filename);
 
 }
 
@@ -4,12 +4,16 @@
 #endif
 
 
+#include <stdio.h>
 #include <string>
 #include "audiere.h"
 #include "debug.h"
 #include "device_null.h"
+#include "device_virtual.h"
+#include "event_dispatcher.h"
 #include "internal.h"
 #include "threads.h"
+#include "timer.h"
 
 #ifdef _MSC_VER
 
@@ -51,31 +55,21 @@
 namespace audiere {
 
   AbstractDevice::AbstractDevice() {
-    m_thread_exists = false;
-    m_thread_should_die = false;
-
-    bool result = AI_CreateThread(eventThread, this, 2);
-    if (!result) {
-      ADR_LOG("THREAD CREATION FAILED");
-    }
+    // start the dispatcher now rather than on the first event, which is
+    // likely to come from the audio thread
+    m_dispatcher = &EventDispatcher::get();
   }
 
   AbstractDevice::~AbstractDevice() {
-    m_thread_should_die = true;
-
-    // Trick the thread into no longer waiting.
-    m_events_available.notify();
-
-    while (m_thread_exists) {
-      AI_Sleep(50);
-    }
   }
 
   void AbstractDevice::registerCallback(Callback* callback) {
+    SYNCHRONIZED(m_callback_mutex);
     m_callbacks.push_back(callback);
   }
 
   void AbstractDevice::unregisterCallback(Callback* callback) {
+    SYNCHRONIZED(m_callback_mutex);
     for (size_t i = 0; i < m_callbacks.size(); ++i) {
       if (m_callbacks[i] == callback) {
         m_callbacks.erase(m_callbacks.begin() + i);
@@ -85,70 +79,38 @@ namespace audiere {
   }
 
   void AbstractDevice::clearCallbacks() {
+    SYNCHRONIZED(m_callback_mutex);
     m_callbacks.clear();
   }
 
-  void AbstractDevice::fireStopEvent(OutputStreamPtr stream, StopEvent::Reason reason) {
-    StopEventPtr event = new StopEventImpl(stream, reason);
-    fireStopEvent(event);
+  void AbstractDevice::wake() {
+    m_wake.raise();
   }
 
-  void AbstractDevice::fireStopEvent(const StopEventPtr& event) {
-    m_event_mutex.lock();
-    m_events.push(event.get());
-    m_event_mutex.unlock();
-    m_events_available.notify();
+  bool AbstractDevice::waitForWake(int milliseconds) {
+    return m_wake.wait(milliseconds);
   }
 
-  void AbstractDevice::eventThread(void* arg) {
-    ADR_GUARD("AbstractDevice::eventThread[static]");
-    ADR_LOG(arg ? "arg is valid" : "arg is not valid");
-    
-    AbstractDevice* This = static_cast<AbstractDevice*>(arg);
-    This->eventThread();
+  int AbstractDevice::getWakeDescriptor() {
+    return m_wake.getDescriptor();
   }
 
-  void AbstractDevice::eventThread() {
-    ADR_GUARD("AbstractDevice::eventThread");
-    m_thread_exists = true;
-    while (!m_thread_should_die) {
-      m_event_mutex.lock();
-      while (m_events.empty()) {
-        m_events_available.wait(m_event_mutex, 1);
-        if (m_thread_should_die) {
-          break;
-        }
-      }
-      if (m_thread_should_die) {
-        m_event_mutex.unlock();
-        break;
-      }
-
-      // Make a local copy of the events so they can be processed without
-      // leaving the mutex locked.
-      EventQueue events = m_events;
-
-      // Queues don't support clear().  o_o
-      while (!m_events.empty()) {
-        m_events.pop();
-      }
-
-      m_event_mutex.unlock();
-
-      // Process the events.
-      while (!events.empty()) {
-        EventPtr event = events.front();
-        events.pop();
-        processEvent(event.get());
-      }
-    }
-    m_thread_exists = false;
+  void AbstractDevice::fireStopEvent(OutputStream* stream, StopEvent::Reason reason) {
+    m_dispatcher->postStopEvent(this, stream, reason);
   }
 
   void AbstractDevice::processEvent(Event* event) {
-    for (size_t i = 0; i < m_callbacks.size(); ++i) {
-      if (event->getType() == m_callbacks[i]->getType()) {
-        m_callbacks[i]->call(event);
+    // Callbacks may be registered and unregistered from other threads,
+    // and from within callbacks, so call them from a copy of the list.
+    std::vector<CallbackPtr> callbacks;
+    {
+      SYNCHRONIZED(m_callback_mutex);
+      callbacks = m_callbacks;
+    }
+
+    for (size_t i = 0; i < callbacks.size(); ++i) {
+      if (event->getType() == callbacks[i]->getType()) {
+        callbacks[i]->call(event);
       }
     }
   }
@@ -183,6 +145,7 @@ namespace audiere {
 #endif
 
 #endif
+      "virtual:Virtual mixer (no sound, mixes in real time)"  ";"
       "null:Null output (no sound)"  ;
   }
 
@@ -190,7 +153,7 @@ namespace audiere {
   #define NEED_SEMICOLON do ; while (false)
 
   #define TRY_GROUP(group_name) {                               \
-    AudioDevice* device = DoOpenDevice(group_name, parameters); \
+    AbstractDevice* device = DoOpenDevice(group_name, parameters); \
     if (device) {                                               \
       return device;                                            \
     }                                                           \
@@ -204,7 +167,7 @@ namespace audiere {
   } NEED_SEMICOLON
 
 
-  AudioDevice* DoOpenDevice(
+  AbstractDevice* DoOpenDevice(
     const std::string& name,
     const ParameterList& parameters)
   {
@@ -233,6 +196,11 @@ namespace audiere {
         return 0;
       }
 
+      if (name == "virtual") {
+        TRY_DEVICE(VirtualAudioDevice);
+        return 0;
+      }
+
     #else  // not Win32 - assume autoconf UNIX
 
       if (name == "" || name == "autodetect") {
@@ -301,6 +269,11 @@ namespace audiere {
         return 0;
       }
 
+      if (name == "virtual") {
+        TRY_DEVICE(VirtualAudioDevice);
+        return 0;
+      }
+
     #endif
 
     // no devices
@@ -310,7 +283,20 @@ namespace audiere {
 
   class ThreadedDevice : public RefImplementation<AudioDevice> {
   public:
-    ThreadedDevice(AudioDevice* device) {
+    /// Bytes of the update thread's stack locked when mlock is asked for.
+    enum { LOCKED_STACK_SIZE = 64 * 1024 };
+
+    /**
+     * Starts the thread that updates device.  If the system refuses
+     * schedule, falls back to the default scheduling unless
+     * realtime_required is set, in which case isRunning() is false.
+     */
+    ThreadedDevice(
+      AbstractDevice* device,
+      const AI_ThreadSchedule& schedule,
+      bool realtime_required,
+      bool lock_memory)
+    {
       ADR_GUARD("ThreadedDevice::ThreadedDevice");
       if (device) {
         ADR_LOG("Device is valid");
@@ -319,20 +305,34 @@ namespace audiere {
       }
 
       m_device = device;
-      m_thread_exists = false;
       m_thread_should_die = false;
-
-      /// @todo  what if thread creation fails?
-      bool result = AI_CreateThread(threadRoutine, this, 2);
-      if (!result) {
+      m_lock_memory = lock_memory;
+
+      m_thread = AI_CreateJoinableThread(threadRoutine, this, schedule);
+      if (!m_thread && !realtime_required &&
+          (schedule.policy != AI_SCHED_DEFAULT || schedule.cpu_mask))
+      {
+        ADR_LOG("Falling back to the default scheduling");
+        AI_ThreadSchedule fallback;
+        fallback.priority = 2;
+        m_thread = AI_CreateJoinableThread(threadRoutine, this, fallback);
+      }
+      if (!m_thread) {
         ADR_LOG("THREAD CREATION FAILED");
       }
     }
 
+    bool isRunning() {
+      return (m_thread != 0);
+    }
+
     ~ThreadedDevice() {
-      m_thread_should_die = true;
-      while (m_thread_exists) {
-        AI_Sleep(50);
+      ADR_GUARD("ThreadedDevice::~ThreadedDevice");
+      if (m_thread) {
+        // the device is released after the thread is done with it
+        m_thread_should_die = true;
+        m_device->wake();
+        AI_JoinThread(m_thread);
       }
     }
 
@@ -353,6 +353,10 @@ namespace audiere {
         channel_count, sample_rate, sample_format);
     }
 
+    OutputStream* ADR_CALL openSampleBuffer(SampleBuffer* buffer) {
+      return m_device->openSampleBuffer(buffer);
+    }
+
     const char* ADR_CALL getName() {
       return m_device->getName();
     }
@@ -369,14 +373,49 @@ namespace audiere {
       m_device->clearCallbacks();
     }
 
+    int ADR_CALL getSampleRate() {
+      return m_device->getSampleRate();
+    }
+
+    int ADR_CALL getPeriodSize() {
+      return m_device->getPeriodSize();
+    }
+
+    int ADR_CALL getPeriodCount() {
+      return m_device->getPeriodCount();
+    }
+
+    bool ADR_CALL getStats(DeviceStats& stats) {
+      return m_device->getStats(stats);
+    }
+
+    int ADR_CALL getLatency() {
+      return m_device->getLatency();
+    }
+
+    bool ADR_CALL getClock(s64& frames, u64& timestamp) {
+      return m_device->getClock(frames, timestamp);
+    }
+
+    OutputTap* ADR_CALL openTap(int frame_count) {
+      return m_device->openTap(frame_count);
+    }
+
   private:
     void run() {
       ADR_GUARD("ThreadedDevice::run");
-      m_thread_exists = true;
+      void* locked_stack = 0;
+      if (m_lock_memory) {
+        // the mixer mixes into buffers on this stack
+        locked_stack = AI_LockStack(LOCKED_STACK_SIZE);
+      }
       while (!m_thread_should_die) {
         m_device->update();
       }
-      m_thread_exists = false;
+      if (locked_stack) {
+        // the stack may be cached for another thread
+        AI_UnlockMemory(locked_stack, LOCKED_STACK_SIZE);
+      }
     }
 
     static void threadRoutine(void* arg) {
@@ -392,12 +431,82 @@ namespace audiere {
     }
 
   private:
-    RefPtr<AudioDevice> m_device;
+    RefPtr<AbstractDevice> m_device;
     volatile bool m_thread_should_die;
-    volatile bool m_thread_exists;
+    AI_Thread m_thread;
+    bool m_lock_memory;
   };
 
 
+  /**
+   * Parses a 64-bit processor mask, hexadecimal with a 0x prefix or
+   * decimal.  unsigned long is only 32 bits on some systems, so this
+   * doesn't use strtoul.
+   */
+  static bool ParseCPUMask(const std::string& text, u64& mask) {
+    const char* p = text.c_str();
+    u64 base = 10;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+      base = 16;
+      p += 2;
+    }
+    if (!*p) {
+      return false;
+    }
+
+    mask = 0;
+    for (; *p; ++p) {
+      u64 digit;
+      if (*p >= '0' && *p <= '9') {
+        digit = *p - '0';
+      } else if (base == 16 && *p >= 'a' && *p <= 'f') {
+        digit = *p - 'a' + 10;
+      } else if (base == 16 && *p >= 'A' && *p <= 'F') {
+        digit = *p - 'A' + 10;
+      } else {
+        return false;
+      }
+
+      // refuse masks that don't fit
+      if (mask > (~u64(0) - digit) / base) {
+        return false;
+      }
+      mask = mask * base + digit;
+    }
+    return true;
+  }
+
+
+  /// Reads the update thread's scheduling from the device parameters.
+  static AI_ThreadSchedule GetThreadSchedule(const ParameterList& parameters) {
+    AI_ThreadSchedule schedule;
+
+    std::string sched = parameters.getValue("sched", "other");
+    if (sched == "fifo") {
+      schedule.policy = AI_SCHED_FIFO;
+    } else if (sched == "rr") {
+      schedule.policy = AI_SCHED_RR;
+    } else if (sched != "other") {
+      ADR_LOG("Unknown sched parameter, using the default scheduling");
+    }
+
+    // real-time priorities are absolute, others are relative to the default
+    schedule.priority = parameters.getInt(
+      "priority",
+      schedule.policy == AI_SCHED_DEFAULT ? 2 : 10);
+
+    // accepts hexadecimal, e.g. cpu_mask=0x3 for the first two processors
+    std::string mask = parameters.getValue("cpu_mask", "0");
+    if (!ParseCPUMask(mask, schedule.cpu_mask)) {
+      fprintf(stderr, "cpu_mask: can't parse '%s', allowing any processor\n",
+              mask.c_str());
+      schedule.cpu_mask = 0;
+    }
+
+    return schedule;
+  }
+
+
   ADR_EXPORT(AudioDevice*) AdrOpenDevice(
     const char* name,
     const char* parameters)
@@ -412,16 +521,30 @@ namespace audiere {
     }
 
     // first, we need an unthreaded audio device
-    AudioDevice* device = DoOpenDevice(
-      std::string(name),
-      ParameterList(parameters));
+    ParameterList parameter_list(parameters);
+    AbstractDevice* device = DoOpenDevice(std::string(name), parameter_list);
     if (!device) {
       ADR_LOG("Could not open device");
       return 0;
     }
 
     ADR_LOG("creating threaded device");
-    return new ThreadedDevice(device);
+    ThreadedDevice* threaded = new ThreadedDevice(
+      device,
+      GetThreadSchedule(parameter_list),
+      parameter_list.getBoolean("realtime_required", false),
+      parameter_list.getBoolean("mlock", false));
+    if (!threaded->isRunning()) {
+      // takes the device down with it
+      AudioDevicePtr discard(threaded);
+      return 0;
+    }
+    return threaded;
+  }
+
+
+  ADR_EXPORT(u64) AdrGetMonotonicTime() {
+    return GetMonotonicNow();
   }
 
 }
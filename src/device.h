@@ -2,7 +2,7 @@
 #define DEVICE_H
 
 
-#include <queue>
+#include <vector>
 #include "audiere.h"
 #include "threads.h"
 
@@ -31,6 +31,9 @@ namespace audiere {
   };
 
 
+  class EventDispatcher;
+
+
   /// Contains default implementation of functionality common to all devices.
   class AbstractDevice : public RefImplementation<AudioDevice> {
   protected:
@@ -42,23 +45,45 @@ namespace audiere {
     void ADR_CALL unregisterCallback(Callback* callback);
     void ADR_CALL clearCallbacks();
 
+    /**
+     * Makes the current or next update() return as soon as it can, e.g.
+     * so the thread calling it can exit.  Any thread may call it.
+     */
+    void wake();
+
   protected:
-    void fireStopEvent(OutputStreamPtr stream, StopEvent::Reason reason);
-    void fireStopEvent(const StopEventPtr& event);
+    /**
+     * Waits for up to milliseconds, or until wake() is called.  Devices
+     * that have to wait in update() wait here rather than sleeping.
+     *
+     * @return  true if woken
+     */
+    bool waitForWake(int milliseconds);
+
+    /**
+     * Returns a descriptor that polls readable once wake() is called,
+     * for devices that wait in poll(), or -1 if there is none.  Call
+     * waitForWake(0) to lower it.
+     */
+    int getWakeDescriptor();
+
+    /**
+     * Queues the event for the callbacks, which are called on another
+     * thread.  Doesn't lock or allocate, so it can be called while
+     * mixing.
+     */
+    void fireStopEvent(OutputStream* stream, StopEvent::Reason reason);
 
   private:
-    static void eventThread(void* arg);
-    void eventThread();
-    void processEvent(Event* event);
+    friend class EventDispatcher;
 
-    volatile bool m_thread_exists;
-    volatile bool m_thread_should_die;
+    /// Called by the dispatcher.
+    void processEvent(Event* event);
 
-    Mutex m_event_mutex;
-    CondVar m_events_available;
-    typedef std::queue<EventPtr> EventQueue;
-    EventQueue m_events;
+    EventDispatcher* m_dispatcher;
+    Signal m_wake;
 
+    Mutex m_callback_mutex;
     std::vector<CallbackPtr> m_callbacks;
   };
 
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <alsa/asoundlib.h>
 #include "device_alsa.h"
 #include "debug.h"
@@ -10,6 +11,63 @@
 
 namespace audiere {
 
+  /**
+   * Negotiates 16-bit stereo with the given access.  rate, period_size
+   * and period_count are the requested values on entry and the ones the
+   * PCM settled on on return.
+   */
+  static int SetHardwareParams(
+    snd_pcm_t* pcm_handle,
+    snd_pcm_access_t access,
+    unsigned int& rate,
+    snd_pcm_uframes_t& period_size,
+    unsigned int& period_count)
+  {
+    snd_pcm_hw_params_t* params;
+    snd_pcm_hw_params_alloca(&params);
+
+    int status = snd_pcm_hw_params_any(pcm_handle, params);
+    if (status < 0 ||
+        (status = snd_pcm_hw_params_set_rate_resample(pcm_handle, params, 1)) < 0 ||
+        (status = snd_pcm_hw_params_set_access(pcm_handle, params, access)) < 0 ||
+        (status = snd_pcm_hw_params_set_format(pcm_handle, params, SND_PCM_FORMAT_S16_LE)) < 0 ||
+        (status = snd_pcm_hw_params_set_channels(pcm_handle, params, 2)) < 0 ||
+        (status = snd_pcm_hw_params_set_rate_near(pcm_handle, params, &rate, 0)) < 0 ||
+        (status = snd_pcm_hw_params_set_period_size_near(pcm_handle, params, &period_size, 0)) < 0 ||
+        (status = snd_pcm_hw_params_set_periods_near(pcm_handle, params, &period_count, 0)) < 0 ||
+        (status = snd_pcm_hw_params(pcm_handle, params)) < 0)
+    {
+      return status;
+    }
+
+    // the PCM may have rounded the buffer to something else entirely
+    snd_pcm_hw_params_get_period_size(params, &period_size, 0);
+    snd_pcm_hw_params_get_periods(params, &period_count, 0);
+    return 0;
+  }
+
+
+  /// Starts the PCM once its buffer is full and wakes us a period at a time.
+  static int SetSoftwareParams(
+    snd_pcm_t* pcm_handle,
+    snd_pcm_uframes_t period_size,
+    unsigned int period_count)
+  {
+    snd_pcm_sw_params_t* params;
+    snd_pcm_sw_params_alloca(&params);
+
+    int status = snd_pcm_sw_params_current(pcm_handle, params);
+    if (status < 0 ||
+        (status = snd_pcm_sw_params_set_start_threshold(pcm_handle, params, period_size * period_count)) < 0 ||
+        (status = snd_pcm_sw_params_set_avail_min(pcm_handle, params, period_size)) < 0 ||
+        (status = snd_pcm_sw_params(pcm_handle, params)) < 0)
+    {
+      return status;
+    }
+    return 0;
+  }
+
+
   ALSAAudioDevice*
   ALSAAudioDevice::create(const ParameterList& parameters) {
     std::string devices[] = {
@@ -35,85 +93,314 @@ namespace audiere {
       return 0;
     }
 
-    int rate = 48000;
-    status = snd_pcm_set_params(pcm_handle,
-                                SND_PCM_FORMAT_S16_LE,
-                                SND_PCM_ACCESS_RW_INTERLEAVED,
-                                2, rate, 1, 0);
-    if (status < 0) {
-      rate = 441000;
-      status = snd_pcm_set_params(pcm_handle,
-                                  SND_PCM_FORMAT_S16_LE,
-                                  SND_PCM_ACCESS_RW_INTERLEAVED,
-                                  2, rate, 1, 0);
-      if (status < 0) {
-        ADR_LOG("Couldn't set audio device parameters.");
-        snd_pcm_close(pcm_handle);
-        return 0;
+    const int requested_rate  = parameters.getInt("rate", 48000);
+    const int requested_count = std::max(2, parameters.getInt("period_count", 4));
+    int requested_size = parameters.getInt("period_size", 1024);
+    const int latency = parameters.getInt("latency", 0);  // milliseconds
+    if (latency > 0) {
+      requested_size = requested_rate * latency / 1000 / requested_count;
+    }
+    requested_size = std::max(16, requested_size);
+
+    // Prefer mapping the ring buffer so the mixer can write into it
+    // directly, and fall back to copying into it with snd_pcm_writei.
+    snd_pcm_access_t accesses[2];
+    int access_count = 0;
+    if (parameters.getBoolean("mmap", true)) {
+      accesses[access_count++] = SND_PCM_ACCESS_MMAP_INTERLEAVED;
+    }
+    accesses[access_count++] = SND_PCM_ACCESS_RW_INTERLEAVED;
+
+    unsigned int rate = 0;
+    snd_pcm_uframes_t period_size = 0;
+    unsigned int period_count = 0;
+    bool mmap = false;
+    for (int i = 0; i < access_count; ++i) {
+      rate         = requested_rate;
+      period_size  = requested_size;
+      period_count = requested_count;
+      status = SetHardwareParams(pcm_handle, accesses[i],
+                                 rate, period_size, period_count);
+      if (status >= 0) {
+        mmap = (accesses[i] == SND_PCM_ACCESS_MMAP_INTERLEAVED);
+        break;
       }
     }
+    if (status < 0) {
+      ADR_LOG("Couldn't set audio device parameters.");
+      snd_pcm_close(pcm_handle);
+      return 0;
+    }
 
-    snd_pcm_uframes_t buffer_size;
-    snd_pcm_uframes_t period_size;
-    status = snd_pcm_get_params(pcm_handle, &buffer_size, &period_size);
-    if (status) {
-      ADR_LOG("Couldn't get audio device parameters.");
+    status = SetSoftwareParams(pcm_handle, period_size, period_count);
+    if (status < 0) {
+      ADR_LOG("Couldn't set audio device software parameters.");
       snd_pcm_close(pcm_handle);
       return 0;
     }
 
-    return new ALSAAudioDevice(pcm_handle, rate, 4096);
+    ALSAAudioDevice* device =
+      new ALSAAudioDevice(pcm_handle, rate, period_size, period_count, mmap);
+    device->setIdleTimeout(parameters.getInt("idle_timeout", 1000));
+    if (parameters.getBoolean("mlock", false)) {
+      device->m_buffer_locked =
+        AI_LockMemory(device->m_buffer, device->m_buffer_size);
+    }
+    return device;
   }
 
 
   ALSAAudioDevice::ALSAAudioDevice(snd_pcm_t* pcm_handle,
                                    int rate,
-                                   int buffer_size)
+                                   int period_size,
+                                   int period_count,
+                                   bool mmap)
     : MixerDevice(rate)
   {
     m_pcm_handle = pcm_handle;
-    m_buffer_size = buffer_size;
-    m_buffer = new char [buffer_size];
+    m_period_size = std::max(1, period_size);
+    m_period_count = period_count;
+    m_buffer_size = m_period_size * 4;
+    m_buffer = new char [m_buffer_size];
+    m_buffer_locked = false;
+    m_mmap = mmap;
+
+    const int count = snd_pcm_poll_descriptors_count(m_pcm_handle);
+    if (count > 0) {
+      m_poll_fds.resize(count);
+      if (snd_pcm_poll_descriptors(m_pcm_handle, &m_poll_fds[0], count) != count) {
+        m_poll_fds.clear();
+      }
+    }
+    if (!m_poll_fds.empty()) {
+      // so wake() can interrupt the wait
+      pollfd wake;
+      wake.fd      = getWakeDescriptor();
+      wake.events  = POLLIN;
+      wake.revents = 0;
+      m_poll_fds.push_back(wake);
+    }
+
+    // a couple of periods, in case a wakeup goes missing
+    m_poll_timeout = std::max(10, 2 * 1000 * m_period_size / std::max(1, rate));
   }
 
 
   ALSAAudioDevice::~ALSAAudioDevice() {
     ADR_GUARD("ALSAAudioDevice::~ALSAAudioDevice");
-    snd_pcm_drain(m_pcm_handle);
+    // draining would block until the buffer has played out
+    snd_pcm_drop(m_pcm_handle);
     snd_pcm_close(m_pcm_handle);
+    if (m_buffer_locked) {
+      AI_UnlockMemory(m_buffer, m_buffer_size);
+    }
     delete [] m_buffer;
   }
 
 
   void ADR_CALL
   ALSAAudioDevice::update() {
-    int           ret;
-    int           sample_len;
-    int           sample_left;
-    char*         sample_buf;
-
-    sample_buf = m_buffer;
-    sample_len = m_buffer_size / 4;
-
-    sample_left = read(sample_len, sample_buf);
-    while (sample_left > 0) {
-      ret = snd_pcm_writei(m_pcm_handle, sample_buf, sample_left);
-      if (ret == -EAGAIN || (ret > 0 && ret < sample_left)) {
-        snd_pcm_wait(m_pcm_handle, 10);
-      } else if (ret == -ESTRPIPE) {
-        do {
-          snd_pcm_wait(m_pcm_handle, 10);
-          ret = snd_pcm_resume(m_pcm_handle);
-        } while (ret == -EAGAIN);
-        snd_pcm_prepare(m_pcm_handle);
-      } else if (ret == -EPIPE) {
-        snd_pcm_prepare(m_pcm_handle);
+    if (!waitWhileIdle()) {
+      return;
+    }
+
+    const snd_pcm_sframes_t avail = waitForSpace();
+    if (avail <= 0) {
+      return;
+    }
+
+    if (m_mmap) {
+      writeMmap(avail);
+    } else {
+      writeReadWrite(avail);
+    }
+  }
+
+
+  void
+  ALSAAudioDevice::suspendOutput() {
+    snd_pcm_drop(m_pcm_handle);
+  }
+
+
+  void
+  ALSAAudioDevice::resumeOutput() {
+    // it starts again once the ring is full
+    snd_pcm_prepare(m_pcm_handle);
+  }
+
+
+  snd_pcm_sframes_t
+  ALSAAudioDevice::waitForSpace() {
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(m_pcm_handle);
+    if (avail < 0) {
+      recover(avail);
+      return 0;
+    }
+    if (avail >= m_period_size) {
+      return avail;
+    }
+
+    // The ring is full.  If it filled up before reaching the start
+    // threshold, start it ourselves.
+    if (snd_pcm_state(m_pcm_handle) == SND_PCM_STATE_PREPARED) {
+      snd_pcm_start(m_pcm_handle);
+    }
+
+    // Sleep until avail_min, a period, is free.  The timeout only keeps
+    // the thread responsive if the PCM stops waking us.
+    poll();
+
+    avail = snd_pcm_avail_update(m_pcm_handle);
+    if (avail < 0) {
+      recover(avail);
+      return 0;
+    }
+    return avail;
+  }
+
+
+  void
+  ALSAAudioDevice::poll() {
+    if (m_poll_fds.empty()) {
+      snd_pcm_wait(m_pcm_handle, m_poll_timeout);
+    } else if (::poll(&m_poll_fds[0], m_poll_fds.size(), m_poll_timeout) > 0 &&
+               m_poll_fds.back().revents)
+    {
+      // woken, lower the signal
+      waitForWake(0);
+    }
+  }
+
+
+  void
+  ALSAAudioDevice::writeReadWrite(snd_pcm_uframes_t frame_count) {
+    while (frame_count > 0) {
+      const int count =
+        int(std::min(frame_count, snd_pcm_uframes_t(m_buffer_size / 4)));
+      read(count, m_buffer);
+
+      const char* buffer = m_buffer;
+      int left = count;
+      while (left > 0) {
+        snd_pcm_sframes_t ret;
+        {
+          SYNCHRONIZED(this);
+          ret = snd_pcm_writei(m_pcm_handle, buffer, left);
+          if (ret > 0) {
+            framesWritten(ret);
+          } else if (ret != -EAGAIN) {
+            framesDropped(left);
+          }
+        }
+
+        if (ret == -EAGAIN) {
+          poll();
+        } else if (ret < 0) {
+          // the rest of the mix is lost with the underrun
+          recover(ret);
+          return;
+        } else {
+          buffer += ret * 4;
+          left   -= ret;
+        }
       }
-      if (ret > 0) {
-        sample_buf += ret * 4;
-        sample_left -= ret;
+      frame_count -= count;
+    }
+  }
+
+
+  void
+  ALSAAudioDevice::writeMmap(snd_pcm_uframes_t frame_count) {
+    while (frame_count > 0) {
+      const snd_pcm_channel_area_t* areas;
+      snd_pcm_uframes_t offset;
+      snd_pcm_uframes_t frames = frame_count;
+      int status = snd_pcm_mmap_begin(m_pcm_handle, &areas, &offset, &frames);
+      if (status < 0) {
+        recover(status);
+        return;
+      }
+      if (frames == 0) {
+        break;
+      }
+
+      // Mix straight into the ring when its frames are laid out the way
+      // the mixer writes them, which is the case for interleaved access.
+      char* base = (char*)areas[0].addr + areas[0].first / 8;
+      if (areas[0].step == 32 &&
+          areas[1].step == 32 &&
+          areas[1].addr == areas[0].addr &&
+          areas[1].first == areas[0].first + 16)
+      {
+        read(frames, base + offset * 4);
+      } else {
+        frames = std::min(frames, snd_pcm_uframes_t(m_buffer_size / 4));
+        read(frames, m_buffer);
+        const s16* in = (const s16*)m_buffer;
+        for (snd_pcm_uframes_t i = 0; i < frames; ++i) {
+          for (int c = 0; c < 2; ++c) {
+            const snd_pcm_channel_area_t& area = areas[c];
+            char* out = (char*)area.addr +
+                        (area.first + (offset + i) * area.step) / 8;
+            *(s16*)out = *in++;
+          }
+        }
+      }
+
+      snd_pcm_sframes_t committed;
+      {
+        SYNCHRONIZED(this);
+        committed = snd_pcm_mmap_commit(m_pcm_handle, offset, frames);
+        const int written = std::max(0, int(committed));
+        framesWritten(written);
+        framesDropped(int(frames) - written);
       }
+      if (committed < 0 || snd_pcm_uframes_t(committed) != frames) {
+        recover(committed < 0 ? int(committed) : -EPIPE);
+        return;
+      }
+      frame_count -= frames;
+    }
+  }
+
+
+  void
+  ALSAAudioDevice::recover(int error) {
+    if (error == -ESTRPIPE) {
+      int ret;
+      do {
+        snd_pcm_wait(m_pcm_handle, 10);
+        ret = snd_pcm_resume(m_pcm_handle);
+      } while (ret == -EAGAIN);
+      snd_pcm_prepare(m_pcm_handle);
+    } else if (error == -EPIPE) {
+      snd_pcm_prepare(m_pcm_handle);
+    }
+  }
+
+
+  bool
+  ALSAAudioDevice::getOutputDelay(int& frames) {
+    snd_pcm_sframes_t delay;
+    if (snd_pcm_delay(m_pcm_handle, &delay) < 0) {
+      // after an underrun, nothing is queued
+      delay = 0;
     }
+    frames = int(delay);
+    return true;
+  }
+
+
+  int ADR_CALL
+  ALSAAudioDevice::getPeriodSize() {
+    return m_period_size;
+  }
+
+
+  int ADR_CALL
+  ALSAAudioDevice::getPeriodCount() {
+    return m_period_count;
   }
 
 
@@ -1,6 +1,8 @@
 #ifndef DEVICE_ALSA_H
 #define DEVICE_ALSA_H
 
+#include <vector>
+#include <poll.h>
 #include "audiere.h"
 #include "device_mixer.h"
 
@@ -16,17 +18,52 @@ namespace audiere {
   private:
     ALSAAudioDevice(snd_pcm_t* pcm_handle,
                     int rate,
-                    int buffer_size);
+                    int period_size,
+                    int period_count,
+                    bool mmap);
     ~ALSAAudioDevice();
 
   public:
     void ADR_CALL update();
     const char* ADR_CALL getName();
+    int ADR_CALL getPeriodSize();
+    int ADR_CALL getPeriodCount();
+
+  protected:
+    bool getOutputDelay(int& frames);
+    void suspendOutput();
+    void resumeOutput();
 
   private:
+    /**
+     * Waits on the PCM's poll descriptors until at least a period is
+     * free, and returns how many frames are.  Returns 0 if it gave up.
+     */
+    snd_pcm_sframes_t waitForSpace();
+
+    /// Sleeps until the PCM or wake() wakes us or m_poll_timeout passes.
+    void poll();
+
+    /// Mixes into m_buffer and copies it to the PCM with snd_pcm_writei.
+    void writeReadWrite(snd_pcm_uframes_t frame_count);
+
+    /// Mixes straight into the PCM's mapped ring buffer.
+    void writeMmap(snd_pcm_uframes_t frame_count);
+
+    /// Recovers from an underrun or a suspend reported as error.
+    void recover(int error);
+
     snd_pcm_t* m_pcm_handle;
-    int m_buffer_size;
+    int m_buffer_size;  // bytes
     char* m_buffer;
+    bool m_buffer_locked;
+
+    int m_period_size;  // frames
+    int m_period_count;
+    bool m_mmap;
+
+    std::vector<pollfd> m_poll_fds;  ///< the PCM's, then the wake descriptor
+    int m_poll_timeout;  // milliseconds
   };
 
 }
@@ -137,7 +137,7 @@ namespace audiere {
 
   void ADR_CALL
   CAAudioDevice::update() {
-    AI_Sleep (20);
+    waitForWake(20);
   }
 
 
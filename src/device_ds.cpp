@@ -172,7 +172,7 @@ namespace audiere {
       }
     }
 
-    Sleep(50);
+    waitForWake(50);
   }
 
 
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include "device_mixer.h"
 #include "resampler.h"
+#include "timer.h"
 #include "utility.h"
 
 
@@ -13,6 +14,16 @@ namespace audiere {
 
   MixerDevice::MixerDevice(int rate) {
     m_rate = rate;
+    m_frames_mixed   = 0;
+    m_frames_pending = 0;
+
+    m_idle_frames      = 0;
+    m_silent_frames    = 0;
+    m_suspended        = false;
+    m_resume_time      = 0;
+    m_suspensions      = 0;
+    m_restart_time     = 0;
+    m_max_restart_time = 0;
   }
 
 
@@ -33,6 +44,185 @@ namespace audiere {
   }
 
 
+  OutputStream*
+  MixerDevice::openSampleBuffer(SampleBuffer* buffer) {
+    if (!buffer) {
+      return 0;
+    }
+
+    // mix straight from the samples when they are laid out in a format
+    // the mixer understands, and read them through a stream otherwise
+    int channel_count, sample_rate;
+    SampleFormat sample_format;
+    buffer->getFormat(channel_count, sample_rate, sample_format);
+    if (buffer->getSamples() && (channel_count == 1 || channel_count == 2)) {
+      return new MixerBufferStream(this, buffer, m_rate);
+    } else {
+      return openStream(buffer->openStream());
+    }
+  }
+
+
+  int
+  MixerDevice::getSampleRate() {
+    return m_rate;
+  }
+
+
+  int
+  MixerDevice::getLatency() {
+    SYNCHRONIZED(this);
+    int frames;
+    return (getUnplayedFrames(frames) ? frames : 0);
+  }
+
+
+  bool
+  MixerDevice::getClock(s64& frames, u64& timestamp) {
+    SYNCHRONIZED(this);
+    int unplayed;
+    if (!getUnplayedFrames(unplayed)) {
+      return false;
+    }
+    frames    = m_frames_mixed - unplayed;
+    timestamp = GetMonotonicNow();
+    return true;
+  }
+
+
+  bool
+  MixerDevice::getStats(DeviceStats& stats) {
+    SYNCHRONIZED(this);
+    stats.frames           = m_frames_mixed;
+    stats.periods          = 0;
+    stats.deadline_misses  = 0;
+    stats.period_time      = 0;
+    stats.cpu_time         = 0;
+    stats.max_cpu_time     = 0;
+    stats.suspensions      = m_suspensions;
+    stats.restart_time     = m_restart_time;
+    stats.max_restart_time = m_max_restart_time;
+    return true;
+  }
+
+
+  OutputTap*
+  MixerDevice::openTap(int frame_count) {
+    // the ring's size has to stay a power of two that fits an int
+    if (frame_count <= 0 || frame_count > (1 << 28)) {
+      return 0;
+    }
+    return new MixerTap(this, frame_count);
+  }
+
+
+  void
+  MixerDevice::setIdleTimeout(int milliseconds) {
+    SYNCHRONIZED(this);
+    m_idle_frames = int(s64(std::max(0, milliseconds)) * m_rate / 1000);
+  }
+
+
+  bool
+  MixerDevice::waitWhileIdle() {
+    {
+      SYNCHRONIZED(this);
+      if (!m_suspended) {
+        // taps expect the mix to go on
+        if (m_idle_frames == 0 || m_silent_frames < m_idle_frames ||
+            !m_taps.empty())
+        {
+          return true;
+        }
+
+        // a stream may have started since the last read()
+        for (std::list<MixerStream*>::iterator i = m_streams.begin();
+             i != m_streams.end();
+             ++i)
+        {
+          if ((*i)->m_is_playing) {
+            m_silent_frames = 0;
+            return true;
+          }
+        }
+
+        // What the output still had queued is never played, so take it
+        // off the clock.
+        int unplayed;
+        if (getUnplayedFrames(unplayed)) {
+          m_frames_mixed -= unplayed;
+          for (std::list<MixerStream*>::iterator i = m_streams.begin();
+               i != m_streams.end();
+               ++i)
+          {
+            (*i)->m_mixed_until = std::min((*i)->m_mixed_until, m_frames_mixed);
+          }
+        }
+        m_frames_pending = 0;
+
+        suspendOutput();
+        m_suspended   = true;
+        m_resume_time = 0;
+        ++m_suspensions;
+      }
+    }
+
+    waitForWake(-1);
+
+    SYNCHRONIZED(this);
+    if (!m_resume_time) {
+      return false;
+    }
+    m_suspended     = false;
+    m_silent_frames = 0;
+    resumeOutput();
+    return true;
+  }
+
+
+  void
+  MixerDevice::streamPlayed() {
+    // restarts the idle countdown if the device hasn't suspended yet
+    m_silent_frames = 0;
+    if (m_suspended && !m_resume_time) {
+      m_resume_time = GetMonotonicNow();
+      wake();
+    }
+  }
+
+
+  void
+  MixerDevice::framesWritten(int frame_count) {
+    m_frames_pending = std::max(0, m_frames_pending - frame_count);
+
+    if (m_resume_time && !m_suspended) {
+      // the first write since resuming
+      m_restart_time = int(GetMonotonicNow() - m_resume_time);
+      m_max_restart_time = std::max(m_max_restart_time, m_restart_time);
+      m_resume_time = 0;
+    }
+  }
+
+
+  void
+  MixerDevice::framesDropped(int frame_count) {
+    frame_count = std::min(frame_count, m_frames_pending);
+    m_frames_pending -= frame_count;
+    m_frames_mixed   -= frame_count;
+  }
+
+
+  bool
+  MixerDevice::getUnplayedFrames(int& frames) {
+    int delay;
+    if (!getOutputDelay(delay)) {
+      return false;
+    }
+    frames = m_frames_pending + std::max(0, delay);
+    return true;
+  }
+
+
   int
   MixerDevice::read(const int sample_count, void* samples) {
 //    ADR_GUARD("MixerDevice::read");
@@ -50,24 +240,29 @@ namespace audiere {
       any_playing |= (*i)->m_is_playing;
     }
   
+    // Devices hand over everything from one read() before the next, so
+    // anything still pending from the last one was lost.
+    m_frames_mixed  += sample_count;
+    m_frames_pending = sample_count;
+
     // if not, return zeroed samples
     if (!any_playing) {
+      m_silent_frames = std::min(m_silent_frames + sample_count, m_idle_frames);
       memset(samples, 0, 4 * sample_count);
+      writeTaps(samples, sample_count);
       return sample_count;
     }
+    m_silent_frames = 0;
 
     ADR_LOG("at least one stream is playing");
 
-    // buffer in which to mix the audio
-    static const int BUFFER_SIZE = 4096;
-
-    // mix the output in chunks of BUFFER_SIZE samples
+    // mix the output in chunks of BUFFER_SIZE frames
     s16* out = (s16*)samples;
     int left = sample_count;
     while (left > 0) {
-      int to_mix = std::min(BUFFER_SIZE, left);
+      int to_mix = std::min(int(BUFFER_SIZE), left);
 
-      s32 mix_buffer[BUFFER_SIZE];
+      s32 mix_buffer[BUFFER_SIZE * 2];
       memset(mix_buffer, 0, sizeof(mix_buffer));
     
       for (std::list<MixerStream*>::iterator s = m_streams.begin();
@@ -75,11 +270,9 @@ namespace audiere {
            ++s)
       {
         if ((*s)->m_is_playing) {
-          s16 stream_buffer[BUFFER_SIZE * 2];
-          (*s)->read(to_mix, stream_buffer);
-          for (int i = 0; i < to_mix * 2; ++i) {
-            mix_buffer[i] += stream_buffer[i];
-          }
+          (*s)->mix(to_mix, mix_buffer);
+          (*s)->m_mixed_until =
+            m_frames_mixed - sample_count + (sample_count - left) + to_mix;
         }
       }
 
@@ -97,17 +290,44 @@ namespace audiere {
       left -= to_mix;
     }
 
+    writeTaps(samples, sample_count);
     return sample_count;
   }
 
 
+  void
+  MixerDevice::writeTaps(const void* samples, int frame_count) {
+    for (std::list<MixerTap*>::iterator i = m_taps.begin();
+         i != m_taps.end();
+         ++i)
+    {
+      (*i)->write((const s16*)samples, frame_count);
+    }
+  }
+
+
   MixerStream::MixerStream(
     MixerDevice* device,
     SampleSource* source,
     int rate)
   {
+    m_source = new Resampler(source, rate);
+    init(device);
+  }
+
+
+  MixerStream::MixerStream(MixerDevice* device) {
+    init(device);
+  }
+
+
+  void
+  MixerStream::init(MixerDevice* device) {
     m_device     = device;
-    m_source     = new Resampler(source, rate);
+    m_primed_position = 0;
+    m_prime_position  = 0;
+    m_priming    = false;
+    m_mixed_until = 0;
     m_last_l     = 0;
     m_last_r     = 0;
     m_is_playing = false;
@@ -128,7 +348,9 @@ namespace audiere {
   void
   MixerStream::play() {
     SYNCHRONIZED(m_device.get());
+    waitForPrime();
     m_is_playing = true;
+    m_device->streamPlayed();
   }
 
 
@@ -154,6 +376,8 @@ namespace audiere {
   void
   MixerStream::reset() {
     SYNCHRONIZED(m_device.get());
+    waitForPrime();
+    m_primed.clear();
     m_source->reset();
   }
 
@@ -161,6 +385,7 @@ namespace audiere {
   void
   MixerStream::setRepeat(bool repeat) {
     SYNCHRONIZED(m_device.get());
+    waitForPrime();
     m_source->setRepeat(repeat);
   }
 
@@ -168,6 +393,7 @@ namespace audiere {
   bool
   MixerStream::getRepeat() {
     SYNCHRONIZED(m_device.get());
+    waitForPrime();
     return m_source->getRepeat();
   }
 
@@ -203,6 +429,16 @@ namespace audiere {
   void
   MixerStream::setPitchShift(float shift) {
     SYNCHRONIZED(m_device.get());
+    waitForPrime();
+
+    // primed frames were resampled at the old pitch, so decode them again
+    // if none have been played yet
+    if (!m_primed.empty() && m_primed_position == 0 &&
+        shift != m_source->getPitchShift() && m_source->isSeekable())
+    {
+      m_primed.clear();
+      m_source->setPosition64(m_prime_position);
+    }
     m_source->setPitchShift(shift);
   }
 
@@ -210,6 +446,7 @@ namespace audiere {
   float
   MixerStream::getPitchShift() {
     SYNCHRONIZED(m_device.get());
+    waitForPrime();
     return m_source->getPitchShift();
   }
 
@@ -222,54 +459,229 @@ namespace audiere {
 
   int
   MixerStream::getLength() {
-    return m_source->getLength();
+    return ClampToInt(getLength64());
   }
 
 
   void
   MixerStream::setPosition(int position) {
-    SYNCHRONIZED(m_device.get());
-    m_source->setPosition(position);
+    setPosition64(position);
   }
 
 
   int
   MixerStream::getPosition() {
+    return ClampToInt(getPosition64());
+  }
+
+
+  s64
+  MixerStream::getLength64() {
+    return m_source->getLength64();
+  }
+
+
+  /// Wraps or clamps a position that latency compensation took below 0.
+  static s64 WrapPosition(s64 position, s64 length, bool repeat) {
+    if (position >= 0) {
+      return position;
+    }
+    if (repeat && length > 0) {
+      return length - 1 - (-position - 1) % length;
+    }
+    return 0;
+  }
+
+
+  void
+  MixerStream::setPosition64(s64 position) {
+    SYNCHRONIZED(m_device.get());
+    waitForPrime();
+    m_primed.clear();
+    m_source->setPosition64(position);
+  }
+
+
+  s64
+  MixerStream::getPosition64() {
+    SYNCHRONIZED(m_device.get());
+    waitForPrime();
+    if (m_primed.empty()) {
+      return m_source->getPosition64();
+    }
+
+    // the source is ahead by the primed frames that haven't been mixed
+    if (m_primed_position == 0) {
+      return m_prime_position;
+    }
+    const int unmixed = int(m_primed.size() / 2) - m_primed_position;
+    const s64 position = m_source->getPosition64() -
+                         s64(unmixed * m_source->getSourceRatio() + 0.5);
+    return WrapPosition(position, m_source->getLength64(), m_source->getRepeat());
+  }
+
+
+  bool
+  MixerStream::prime() {
+    ADR_GUARD("MixerStream::prime");
+
+    {
+      SYNCHRONIZED(m_device.get());
+      waitForPrime();
+      if (m_is_playing || !m_primed.empty()) {
+        return !m_primed.empty();
+      }
+      m_priming = true;
+      m_prime_position = m_source->getPosition64();
+    }
+
+    // Decode without the lock so the mixer isn't held up.  The stream
+    // isn't playing, so the mixer won't touch the source meanwhile.
+    std::vector<s16> primed(MixerDevice::BUFFER_SIZE * 2);
+    const int read = m_source->read(MixerDevice::BUFFER_SIZE, &primed[0]);
+    primed.resize(read * 2);
+
+    m_device->lock();
+    m_primed.swap(primed);
+    m_primed_position = 0;
+    m_priming = false;
+    m_device->unlock();
+    m_prime_done.notify();
+
+    return (read > 0);
+  }
+
+
+  s64
+  MixerStream::getPlayedPosition() {
     SYNCHRONIZED(m_device.get());
-    return m_source->getPosition();
+    waitForPrime();
+
+    // primed frames are decoded but not even mixed yet
+    int behind = getUnplayedFrames();
+    if (!m_primed.empty()) {
+      behind += int(m_primed.size() / 2) - m_primed_position;
+    }
+
+    const s64 position = m_source->getPosition64() -
+                         s64(behind * m_source->getSourceRatio() + 0.5);
+    return WrapPosition(position, m_source->getLength64(), m_source->getRepeat());
+  }
+
+
+  int
+  MixerStream::getUnplayedFrames() {
+    int frames;
+    if (!m_device->getUnplayedFrames(frames)) {
+      return 0;
+    }
+    // whatever was mixed after this stream's last frames plays after them
+    const s64 after = m_device->m_frames_mixed - m_mixed_until;
+    return int(std::max(s64(0), frames - after));
+  }
+
+
+  void
+  MixerStream::waitForPrime() {
+    while (m_priming) {
+      m_prime_done.wait(*m_device, 1);
+    }
+  }
+
+
+  void
+  MixerStream::mix(int frame_count, s32* mix_buffer) {
+    s16 stream_buffer[MixerDevice::BUFFER_SIZE * 2];
+
+    read(frame_count, stream_buffer);
+    for (int i = 0; i < frame_count * 2; ++i) {
+      mix_buffer[i] += stream_buffer[i];
+    }
+  }
+
+
+  void
+  MixerStream::getChannelVolumes(int& l_volume, int& r_volume) {
+    // do panning and volume normalization
+    if (m_pan < 0) {
+      l_volume = 255;
+      r_volume = 255 + m_pan;
+    } else {
+      l_volume = 255 - m_pan;
+      r_volume = 255;
+    }
+
+    l_volume *= m_volume;
+    r_volume *= m_volume;
+  }
+
+
+  void
+  MixerStream::streamEnded() {
+    if (m_is_playing) {
+      m_is_playing = false;
+      // let subscribers know that the sound was stopped
+      m_device->fireStopEvent(this, StopEvent::STREAM_ENDED);
+    }
   }
 
 
   void
   MixerStream::read(int frame_count, s16* buffer) {
-    unsigned read = m_source->read(frame_count, buffer);
+    int l_volume, r_volume;
+    getChannelVolumes(l_volume, r_volume);
+
+    unsigned read = 0;
     s16* out = buffer;
 
-    // if we are done with the sample source, stop and reset it
-    if (read == 0) {
-      m_source->reset();
-      if (m_is_playing) {
-        m_is_playing = false;
-        // let subscribers know that the sound was stopped
-        m_device->fireStopEvent(this, StopEvent::STREAM_ENDED);
-      } else {
-        m_is_playing = false;
+    // frames decoded ahead of time by prime() go first
+    if (!m_primed.empty()) {
+      const int primed_frames = int(m_primed.size() / 2);
+      const int count = std::min(frame_count, primed_frames - m_primed_position);
+      const s16* in = &m_primed[m_primed_position * 2];
+      for (int i = 0; i < count; ++i) {
+        *out++ = *in++ * l_volume / 255 / 255;
+        *out++ = *in++ * r_volume / 255 / 255;
       }
-    } else {
-      // do panning and volume normalization
-      int l_volume, r_volume;
-      if (m_pan < 0) {
-        l_volume = 255;
-        r_volume = 255 + m_pan;
-      } else {
-        l_volume = 255 - m_pan;
-        r_volume = 255;
+      read += count;
+
+      m_primed_position += count;
+      if (m_primed_position == primed_frames) {
+        std::vector<s16>().swap(m_primed);
+        m_primed_position = 0;
+      }
+    }
+
+    // if the resampler can lend out frames, scale them straight from the
+    // source's memory instead of having them copied through read()
+    while (int(read) < frame_count) {
+      const void* block;
+      int borrowed = m_source->acquireBlock(frame_count - read, block);
+      if (borrowed <= 0) {
+        break;
+      }
+
+      const s16* in = (const s16*)block;
+      for (int i = 0; i < borrowed; ++i) {
+        *out++ = *in++ * l_volume / 255 / 255;
+        *out++ = *in++ * r_volume / 255 / 255;
       }
 
-      l_volume *= m_volume;
-      r_volume *= m_volume;
+      m_source->releaseBlock(borrowed);
+      read += borrowed;
+    }
 
-      for (unsigned i = 0; i < read; ++i) {
+    const unsigned borrowed_total = read;
+    if (int(read) < frame_count) {
+      read += m_source->read(frame_count - read, out);
+    }
+
+    // if we are done with the sample source, stop and reset it
+    if (read == 0) {
+      m_source->reset();
+      streamEnded();
+    } else {
+      for (unsigned i = borrowed_total; i < read; ++i) {
         *out = *out * l_volume / 255 / 255;
         ++out;
         *out = *out * r_volume / 255 / 255;
@@ -296,4 +708,332 @@ namespace audiere {
     m_last_r = new_r;
   }
 
+
+  inline s32 SampleToS16(u8 sample)  { return (s32(sample) - 128) * 256; }
+  inline s32 SampleToS16(s16 sample) { return sample; }
+
+
+  /**
+   * Adds frames from samples to out until frame_count frames are mixed or
+   * the end is reached, and returns how many were mixed.  The last frame
+   * mixed is stored in last_l and last_r.  Resampling interpolates
+   * linearly between neighbouring frames.
+   */
+  template<typename Sample, int CHANNELS, bool RESAMPLE>
+  static int MixFrames(
+    const Sample* samples, int sample_frames, bool repeat,
+    u64& position, u64 step,
+    int frame_count, s32* out, int l_volume, int r_volume,
+    s16& last_l, s16& last_r)
+  {
+    int mixed = 0;
+    while (mixed < frame_count) {
+      int index = int(position >> 32);
+      if (index >= sample_frames) {
+        if (!repeat || sample_frames == 0) {
+          break;
+        }
+        position -= u64(sample_frames) << 32;
+        continue;
+      }
+
+      const Sample* frame = samples + index * CHANNELS;
+      s32 l = SampleToS16(frame[0]);
+      s32 r = (CHANNELS == 2 ? SampleToS16(frame[1]) : l);
+
+      if (RESAMPLE) {
+        int next = index + 1;
+        if (next == sample_frames) {
+          next = (repeat ? 0 : index);
+        }
+        const Sample* next_frame = samples + next * CHANNELS;
+        s32 next_l = SampleToS16(next_frame[0]);
+        s32 next_r = (CHANNELS == 2 ? SampleToS16(next_frame[1]) : next_l);
+
+        // 15 bits of fraction keep the product inside an s32
+        s32 frac = s32((position >> 17) & 0x7FFF);
+        l += (next_l - l) * frac / 32768;
+        r += (next_r - r) * frac / 32768;
+      }
+
+      last_l = s16(l * l_volume / 255 / 255);
+      last_r = s16(r * r_volume / 255 / 255);
+      *out++ += last_l;
+      *out++ += last_r;
+
+      position += step;
+      ++mixed;
+    }
+    return mixed;
+  }
+
+
+  template<typename Sample, int CHANNELS>
+  static int MixFrames(
+    const Sample* samples, int sample_frames, bool repeat,
+    u64& position, u64 step,
+    int frame_count, s32* out, int l_volume, int r_volume,
+    s16& last_l, s16& last_r)
+  {
+    if (step == (u64(1) << 32)) {
+      return MixFrames<Sample, CHANNELS, false>(
+        samples, sample_frames, repeat, position, step,
+        frame_count, out, l_volume, r_volume, last_l, last_r);
+    } else {
+      return MixFrames<Sample, CHANNELS, true>(
+        samples, sample_frames, repeat, position, step,
+        frame_count, out, l_volume, r_volume, last_l, last_r);
+    }
+  }
+
+
+  MixerBufferStream::MixerBufferStream(
+    MixerDevice* device,
+    SampleBuffer* buffer,
+    int rate)
+  : MixerStream(device)
+  {
+    m_buffer      = buffer;
+    m_samples     = buffer->getSamples();
+    m_frame_count = buffer->getLength();
+    buffer->getFormat(m_channel_count, m_sample_rate, m_sample_format);
+
+    m_rate     = rate;
+    m_shift    = 1;
+    m_repeat   = false;
+    m_position = 0;
+    updateStep();
+  }
+
+
+  MixerBufferStream::~MixerBufferStream() {
+    // leave the mix before this part of the object is destroyed
+    SYNCHRONIZED(m_device.get());
+    m_device->m_streams.remove(this);
+  }
+
+
+  void
+  MixerBufferStream::reset() {
+    SYNCHRONIZED(m_device.get());
+    m_position = 0;
+  }
+
+
+  void
+  MixerBufferStream::setRepeat(bool repeat) {
+    SYNCHRONIZED(m_device.get());
+    m_repeat = repeat;
+  }
+
+
+  bool
+  MixerBufferStream::getRepeat() {
+    SYNCHRONIZED(m_device.get());
+    return m_repeat;
+  }
+
+
+  void
+  MixerBufferStream::setPitchShift(float shift) {
+    SYNCHRONIZED(m_device.get());
+    m_shift = shift;
+    updateStep();
+  }
+
+
+  float
+  MixerBufferStream::getPitchShift() {
+    SYNCHRONIZED(m_device.get());
+    return m_shift;
+  }
+
+
+  bool
+  MixerBufferStream::isSeekable() {
+    return true;
+  }
+
+
+  s64
+  MixerBufferStream::getLength64() {
+    return m_frame_count;
+  }
+
+
+  void
+  MixerBufferStream::setPosition64(s64 position) {
+    SYNCHRONIZED(m_device.get());
+    m_position = u64(clamp(s64(0), position, s64(m_frame_count))) << 32;
+  }
+
+
+  s64
+  MixerBufferStream::getPosition64() {
+    SYNCHRONIZED(m_device.get());
+    return s64(m_position >> 32);
+  }
+
+
+  bool
+  MixerBufferStream::prime() {
+    // the samples are mixed straight from memory, there's nothing to decode
+    return true;
+  }
+
+
+  s64
+  MixerBufferStream::getPlayedPosition() {
+    SYNCHRONIZED(m_device.get());
+    const u64 behind = u64(getUnplayedFrames()) * m_step;
+    const s64 position = s64(m_position >> 32) - s64(behind >> 32);
+    return WrapPosition(position, m_frame_count, m_repeat);
+  }
+
+
+  void
+  MixerBufferStream::updateStep() {
+    // like the Resampler, treat a shift of zero as no shift
+    double shift = (m_shift > 0 ? m_shift : 1);
+    double step = shift * m_sample_rate / m_rate;
+    m_step = u64(step * 4294967296.0 + 0.5);
+  }
+
+
+  void
+  MixerBufferStream::mix(int frame_count, s32* mix_buffer) {
+    int l_volume, r_volume;
+    getChannelVolumes(l_volume, r_volume);
+
+    int mixed;
+    if (m_sample_format == SF_U8) {
+      const u8* samples = (const u8*)m_samples;
+      if (m_channel_count == 2) {
+        mixed = MixFrames<u8, 2>(
+          samples, m_frame_count, m_repeat, m_position, m_step,
+          frame_count, mix_buffer, l_volume, r_volume, m_last_l, m_last_r);
+      } else {
+        mixed = MixFrames<u8, 1>(
+          samples, m_frame_count, m_repeat, m_position, m_step,
+          frame_count, mix_buffer, l_volume, r_volume, m_last_l, m_last_r);
+      }
+    } else {
+      const s16* samples = (const s16*)m_samples;
+      if (m_channel_count == 2) {
+        mixed = MixFrames<s16, 2>(
+          samples, m_frame_count, m_repeat, m_position, m_step,
+          frame_count, mix_buffer, l_volume, r_volume, m_last_l, m_last_r);
+      } else {
+        mixed = MixFrames<s16, 1>(
+          samples, m_frame_count, m_repeat, m_position, m_step,
+          frame_count, mix_buffer, l_volume, r_volume, m_last_l, m_last_r);
+      }
+    }
+
+    if (mixed == 0) {
+      m_position = 0;
+      streamEnded();
+    }
+
+    // hold the last frame for the rest of the block, as MixerStream does
+    s32* out = mix_buffer + mixed * 2;
+    for (int i = mixed; i < frame_count; ++i) {
+      *out++ += m_last_l;
+      *out++ += m_last_r;
+    }
+  }
+
+
+
+  MixerTap::MixerTap(MixerDevice* device, int frame_count) {
+    // a power of two, so positions wrapping around don't move the offset
+    m_device   = device;
+    m_capacity = 1;
+    while (m_capacity < frame_count) {
+      m_capacity *= 2;
+    }
+    m_ring.resize(m_capacity * 2);
+    m_write_position = 0;
+    m_read_position  = 0;
+    m_overflows      = 0;
+
+    SYNCHRONIZED(m_device.get());
+    m_device->m_taps.push_back(this);
+  }
+
+
+  MixerTap::~MixerTap() {
+    SYNCHRONIZED(m_device.get());
+    m_device->m_taps.remove(this);
+  }
+
+
+  void
+  MixerTap::getFormat(
+    int& channel_count,
+    int& sample_rate,
+    SampleFormat& sample_format)
+  {
+    channel_count = 2;
+    sample_rate   = m_device->getSampleRate();
+    sample_format = SF_S16;
+  }
+
+
+  void
+  MixerTap::write(const s16* samples, int frame_count) {
+    const unsigned long write_position = m_write_position;
+    const unsigned long read_position  = AI_AtomicLoad(m_read_position);
+    const int space = m_capacity - int(write_position - read_position);
+
+    if (frame_count > space) {
+      AI_AtomicStore(m_overflows, m_overflows + 1);
+      frame_count = space;
+    }
+
+    // copy up to the end of the ring, then from its start
+    const int offset = int(write_position % m_capacity);
+    const int first = std::min(frame_count, m_capacity - offset);
+    memcpy(&m_ring[offset * 2], samples, first * 4);
+    memcpy(&m_ring[0], samples + first * 2, (frame_count - first) * 4);
+
+    // publishes the frames to the reader
+    AI_AtomicStore(m_write_position, long(write_position + frame_count));
+  }
+
+
+  int
+  MixerTap::read(int frame_count, void* buffer) {
+    const unsigned long read_position  = m_read_position;
+    const unsigned long write_position = AI_AtomicLoad(m_write_position);
+    frame_count = std::min(frame_count, int(write_position - read_position));
+    if (frame_count <= 0) {
+      return 0;
+    }
+
+    s16* out = (s16*)buffer;
+    const int offset = int(read_position % m_capacity);
+    const int first = std::min(frame_count, m_capacity - offset);
+    memcpy(out, &m_ring[offset * 2], first * 4);
+    memcpy(out + first * 2, &m_ring[0], (frame_count - first) * 4);
+
+    // hands the space back to the writer
+    AI_AtomicStore(m_read_position, long(read_position + frame_count));
+    return frame_count;
+  }
+
+
+  int
+  MixerTap::getAvailable() {
+    const unsigned long read_position  = m_read_position;
+    const unsigned long write_position = AI_AtomicLoad(m_write_position);
+    return int(write_position - read_position);
+  }
+
+
+  int
+  MixerTap::getOverflowCount() {
+    return AI_AtomicLoad(m_overflows);
+  }
+
 }
@@ -8,6 +8,7 @@
 
 
 #include <list>
+#include <vector>
 #include "audiere.h"
 #include "device.h"
 #include "resampler.h"
@@ -19,6 +20,7 @@
 namespace audiere {
 
   class MixerStream;
+  class MixerTap;
 
 
   /// Always produce 16-bit, stereo audio at the specified rate.
@@ -38,14 +40,90 @@ namespace audiere {
       int sample_rate,
       SampleFormat sample_format);
 
+    OutputStream* ADR_CALL openSampleBuffer(SampleBuffer* buffer);
+
+    int ADR_CALL getSampleRate();
+    int ADR_CALL getLatency();
+    bool ADR_CALL getClock(s64& frames, u64& timestamp);
+    bool ADR_CALL getStats(DeviceStats& stats);
+    OutputTap* ADR_CALL openTap(int frame_count);
+
   protected:
     int read(int sample_count, void* samples);
 
+    /**
+     * Sets how long nothing may play before waitWhileIdle() suspends
+     * the output, or 0, the default, to never suspend it.
+     */
+    void setIdleTimeout(int milliseconds);
+
+    /**
+     * Called by update() before it mixes.  Once nothing has played for
+     * the idle timeout, suspends the output and parks the thread until
+     * a stream is played, then resumes the output.
+     *
+     * @return  false if the thread was woken while still idle, e.g. by
+     *          wake(), and update() should return without writing
+     */
+    bool waitWhileIdle();
+
+    /**
+     * Stops the output and throws away whatever it hasn't played yet,
+     * when the device goes idle.  Called with the mixer locked.
+     */
+    virtual void suspendOutput() { }
+
+    /// Gets the output ready to be written again after suspendOutput().
+    virtual void resumeOutput() { }
+
+    /**
+     * Gets how many frames handed to the output haven't been played yet.
+     * Called with the mixer locked.  Returns false if the device can't
+     * tell, which leaves the device without a clock.
+     */
+    virtual bool getOutputDelay(int& /*frames*/) { return false; }
+
+    /**
+     * Tells the mixer that frame_count frames from the last read() were
+     * handed to the output, or were dropped and never will be.  Call
+     * with the mixer locked, and keep it locked while handing the frames
+     * over, so that a clock query can't count them twice.
+     */
+    void framesWritten(int frame_count);
+    void framesDropped(int frame_count);
+
+    /// Number of frames mixed at a time.
+    enum { BUFFER_SIZE = 4096 };
+
   private:
+    /// Frames mixed but not played yet.  Expects the lock.
+    bool getUnplayedFrames(int& frames);
+
+    /// Restarts the idle countdown and wakes the thread parked in
+    /// waitWhileIdle().  Expects the lock.
+    void streamPlayed();
+
+    /// Copies the output of read() to the taps.  Expects the lock.
+    void writeTaps(const void* samples, int frame_count);
+
     std::list<MixerStream*> m_streams;
+    std::list<MixerTap*> m_taps;
     int m_rate;
 
+    s64 m_frames_mixed;    ///< by read(), less the dropped ones
+    int m_frames_pending;  ///< from the last read(), not yet written
+
+    int m_idle_frames;     ///< silence before suspending, 0 for never
+    int m_silent_frames;   ///< mixed since a stream last played
+    bool m_suspended;
+    u64 m_resume_time;     ///< when a stream was played while suspended
+    int m_suspensions;
+    int m_restart_time;    ///< microseconds from play() to the first write
+    int m_max_restart_time;
+
     friend class MixerStream;
+    friend class MixerBufferStream;
+    friend class MixerTap;
   };
 
 
@@ -54,6 +132,12 @@ namespace audiere {
     MixerStream(MixerDevice* device, SampleSource* source, int rate);
     ~MixerStream();
 
+  protected:
+    /// For subclasses that produce their own frames instead of a source's.
+    MixerStream(MixerDevice* device);
+
+  public:
+
     void  ADR_CALL play();
     void  ADR_CALL stop();
     bool  ADR_CALL isPlaying();
@@ -72,14 +156,58 @@ namespace audiere {
     int  ADR_CALL getLength();
     void ADR_CALL setPosition(int position);
     int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
+
+    bool ADR_CALL prime();
+    s64  ADR_CALL getPlayedPosition();
+
+  protected:
+    /**
+     * Adds frame_count stereo frames to the mix.  Called by the device
+     * with the device locked.
+     */
+    virtual void mix(int frame_count, s32* mix_buffer);
+
+    /// Per-channel gains in [0, 255 * 255] from the volume and pan.
+    void getChannelVolumes(int& l_volume, int& r_volume);
+
+    /// Stops the stream after it ran out of frames.  Expects the lock.
+    void streamEnded();
+
+    /**
+     * Frames of the stream's output that were mixed but not played yet,
+     * at the device's rate.  Expects the lock.
+     */
+    int getUnplayedFrames();
 
   private:
+    void init(MixerDevice* device);
     void read(int frame_count, s16* buffer);
 
-  private:
+    /// Waits, with the lock held, until no prime() is decoding.
+    void waitForPrime();
+
+  protected:
     RefPtr<MixerDevice> m_device;
 
     RefPtr<Resampler> m_source;
+
+    /**
+     * Frames read by prime(), at full volume, played before anything else
+     * is read from m_source.  m_source is used without the lock while
+     * m_priming is set, so nothing else may touch it then.
+     */
+    std::vector<s16> m_primed;
+    int m_primed_position;  ///< in frames
+    s64 m_prime_position;   ///< m_source's position before priming
+    bool m_priming;
+    CondVar m_prime_done;
+
+    /// The device's m_frames_mixed after this stream was last mixed.
+    s64 m_mixed_until;
+
     s16 m_last_l;
     s16 m_last_r;
     bool m_is_playing;
@@ -89,6 +217,97 @@ namespace audiere {
     friend class MixerDevice;
   };
 
+
+  /**
+   * Plays a SampleBuffer by indexing its samples directly, converting,
+   * resampling, and scaling them into the mix in a single pass.  Unlike
+   * a MixerStream over the buffer's stream, nothing is copied through
+   * intermediate buffers and no source methods are called per block.
+   */
+  class MixerBufferStream : public MixerStream {
+  public:
+    MixerBufferStream(MixerDevice* device, SampleBuffer* buffer, int rate);
+    ~MixerBufferStream();
+
+    void  ADR_CALL reset();
+
+    void  ADR_CALL setRepeat(bool repeat);
+    bool  ADR_CALL getRepeat();
+    void  ADR_CALL setPitchShift(float shift);
+    float ADR_CALL getPitchShift();
+
+    bool ADR_CALL isSeekable();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
+
+    bool ADR_CALL prime();
+    s64  ADR_CALL getPlayedPosition();
+
+  protected:
+    void mix(int frame_count, s32* mix_buffer);
+
+  private:
+    void updateStep();
+
+    SampleBufferPtr m_buffer;
+    const void* m_samples;
+    int m_frame_count;
+    int m_channel_count;
+    int m_sample_rate;
+    SampleFormat m_sample_format;
+
+    int m_rate;
+    float m_shift;
+    bool m_repeat;
+
+    /// Position in frames, with 32 fractional bits.
+    u64 m_position;
+
+    /// How far m_position advances per output frame.
+    u64 m_step;
+  };
+
+
+
+  /**
+   * A ring of mixed frames with one writer, the thread mixing with the
+   * device locked, and one reader, which never takes the lock.  Each
+   * side only advances its own position, so neither waits for the
+   * other.
+   */
+  class MixerTap : public RefImplementation<OutputTap> {
+  public:
+    MixerTap(MixerDevice* device, int frame_count);
+    ~MixerTap();
+
+    void ADR_CALL getFormat(
+      int& channel_count,
+      int& sample_rate,
+      SampleFormat& sample_format);
+    int ADR_CALL read(int frame_count, void* buffer);
+    int ADR_CALL getAvailable();
+    int ADR_CALL getOverflowCount();
+
+  private:
+    /// Called by the device with the lock held.
+    void write(const s16* samples, int frame_count);
+
+    RefPtr<MixerDevice> m_device;
+
+    std::vector<s16> m_ring;
+    int m_capacity;  ///< in frames, a power of two
+
+    // Frames ever written and read.  Positions wrap around as unsigned
+    // numbers, so their difference stays right.
+    volatile long m_write_position;
+    volatile long m_read_position;
+
+    volatile long m_overflows;
+
+    friend class MixerDevice;
+  };
+
 }
 
 #endif
@@ -107,7 +107,7 @@ namespace audiere {
         }
       }
     }
-    Sleep(10);
+    waitForWake(10);
   }
 
 
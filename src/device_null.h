@@ -2,91 +2,38 @@
 #define DEVICE_NULL_H
 
 
-#include <list>
+#include <vector>
 #include "audiere.h"
-#include "device.h"
+#include "device_mixer.h"
 #include "internal.h"
-#include "threads.h"
 #include "types.h"
-#include "utility.h"
 
 
 namespace audiere {
 
-  class NullOutputStream;
-
-  class NullAudioDevice : public AbstractDevice, public Mutex {
+  /**
+   * Plays nothing, but mixes its streams as time passes, so that they
+   * advance, end and can be tapped as if they were heard.
+   */
+  class NullAudioDevice : public MixerDevice {
   public:
     static NullAudioDevice* create(const ParameterList& parameters);
 
   private:
-    NullAudioDevice();
+    NullAudioDevice(int rate);
     ~NullAudioDevice();
 
   public:
     void ADR_CALL update();
-    OutputStream* ADR_CALL openStream(SampleSource* source);
-    OutputStream* ADR_CALL openBuffer(
-      void* samples, int frame_count,
-      int channel_count, int sample_rate, SampleFormat sample_format);
     const char* ADR_CALL getName();
 
   private:
-    void removeStream(NullOutputStream* stream);
-
-    typedef std::list<NullOutputStream*> StreamList;
-    StreamList m_streams;
-
-    friend class NullOutputStream;
-  };
-
-  class NullOutputStream : public RefImplementation<OutputStream> {
-  private:
-    NullOutputStream(NullAudioDevice* device, SampleSource* source);
-    ~NullOutputStream();
-
-  public:
-    void ADR_CALL play();
-    void ADR_CALL stop();
-    void ADR_CALL reset();
-    bool ADR_CALL isPlaying();
-
-    void ADR_CALL setRepeat(bool repeat);
-    bool ADR_CALL getRepeat();
-
-    void  ADR_CALL setVolume(float volume);
-    float ADR_CALL getVolume();
-    void  ADR_CALL setPan(float pan);
-    float ADR_CALL getPan();
-    void  ADR_CALL setPitchShift(float shift);
-    float ADR_CALL getPitchShift();
-
-    bool ADR_CALL isSeekable();
-    int  ADR_CALL getLength();
-    void ADR_CALL setPosition(int position);
-    int  ADR_CALL getPosition();
-
-  private:
-    void doStop(bool internal);
-    void resetTimer();
-    void update();
-    int dummyRead(int samples_to_read);
-
-    RefPtr<NullAudioDevice> m_device;
-                          
-    SampleSourcePtr m_source;
-    int m_channel_count;           //
-    int m_sample_rate;             // cached stream format
-    SampleFormat m_sample_format;  //
-
-    bool m_is_playing;
-    float m_volume;
-    float m_pan;
-    float m_shift;
-
-    u64 m_last_update;
+    /// How often update() mixes what has played since.
+    enum { UPDATE_MILLISECONDS = 50 };
 
-    friend class NullAudioDevice;
+    std::vector<s16> m_buffer;
+    u64 m_start;     ///< when mixing started, in microseconds
+    s64 m_position;  ///< frames mixed since then
   };
 
 }
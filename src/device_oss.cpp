@@ -22,65 +22,158 @@ namespace audiere {
       return 0;
     }
 
+    const int requested_rate  = parameters.getInt("rate", 44100);
+    const int requested_count = std::max(2, parameters.getInt("period_count", 4));
+    int requested_size = parameters.getInt("period_size", 512);
+    const int latency = parameters.getInt("latency", 0);  // milliseconds
+    if (latency > 0) {
+      requested_size = requested_rate * latency / 1000 / requested_count;
+    }
+
+    // The fragment size has to be set before anything else.  It is a
+    // power of two in bytes, so round the period up to one.
+    int shift = 4;
+    while (shift < 16 && (1 << shift) < requested_size * 4) {
+      ++shift;
+    }
+    int fragsize = (std::min(requested_count, 0x7fff) << 16) | shift;
+    if (ioctl(output_device, SNDCTL_DSP_SETFRAGMENT, &fragsize) == -1) {
+      perror("SNDCTL_DSP_SETFRAGMENT");
+      close(output_device);
+      return 0;
+    }
+
     int format = AFMT_S16_LE;
     if (ioctl(output_device, SNDCTL_DSP_SETFMT, &format) == -1) {
       perror("SNDCTL_DSP_SETFMT");
+      close(output_device);
       return 0;
     }
     if (format != AFMT_S16_LE) {
       // unsupported format
+      close(output_device);
       return 0;
     }
 
     int stereo = 1;
     if (ioctl(output_device, SNDCTL_DSP_STEREO, &stereo) == -1) {
       perror("SNDCTL_DSP_STEREO");
+      close(output_device);
       return 0;
     }
     if (stereo != 1) {
       // unsupported channel number
+      close(output_device);
       return 0;
     }
 
-    int speed = 44100;
+    int speed = requested_rate;
     if (ioctl(output_device, SNDCTL_DSP_SPEED, &speed) == -1) {
       perror("SNDCTL_DSP_SPEED");
+      close(output_device);
       return 0;
     }
-    if (abs(44100 - speed) > 2205) {
+    if (speed <= 0 || abs(requested_rate - speed) > requested_rate / 20) {
       // unsupported sampling rate
+      close(output_device);
       return 0;
     }
 
-    int fragsize = 0x0004000b; // 4 buffers of 2048 bytes each
-    if (ioctl(output_device, SNDCTL_DSP_SETFRAGMENT, &fragsize) == -1) {
-      perror("SNDCTL_DSP_SETFRAGMENT");
-      return 0;
+    // see what the driver made of the fragment request
+    int period_size  = (1 << shift) / 4;
+    int period_count = requested_count;
+    audio_buf_info info;
+    if (ioctl(output_device, SNDCTL_DSP_GETOSPACE, &info) != -1 &&
+        info.fragsize > 0)
+    {
+      period_size  = info.fragsize / 4;
+      period_count = info.fragstotal;
     }
 
-    return new OSSAudioDevice(output_device);
+    OSSAudioDevice* oss_device =
+      new OSSAudioDevice(output_device, speed, period_size, period_count);
+    oss_device->setIdleTimeout(parameters.getInt("idle_timeout", 1000));
+    if (parameters.getBoolean("mlock", false)) {
+      std::vector<s16>& buffer = oss_device->m_buffer;
+      oss_device->m_buffer_locked =
+        AI_LockMemory(&buffer[0], buffer.size() * sizeof(s16));
+    }
+    return oss_device;
   }
 
 
-  OSSAudioDevice::OSSAudioDevice(int output_device)
-    : MixerDevice(44100)
+  OSSAudioDevice::OSSAudioDevice(
+    int output_device,
+    int rate,
+    int period_size,
+    int period_count)
+    : MixerDevice(rate)
   {
     m_output_device = output_device;
+    m_period_size   = period_size;
+    m_period_count  = period_count;
+    m_buffer.resize(period_size * 2);
+    m_buffer_locked = false;
   }
 
 
   OSSAudioDevice::~OSSAudioDevice() {
     ADR_GUARD("OSSAudioDevice::~OSSAudioDevice");
+    // close() would wait for the buffer to play out
+    ioctl(m_output_device, SNDCTL_DSP_RESET, 0);
     close(m_output_device);
+    if (m_buffer_locked) {
+      AI_UnlockMemory(&m_buffer[0], m_buffer.size() * sizeof(s16));
+    }
   }
 
 
   void ADR_CALL
   OSSAudioDevice::update() {
-    static const int BUFFER_SIZE = 512;
-    char buffer[BUFFER_SIZE * 4];
-    read(BUFFER_SIZE, buffer);
-    write(m_output_device, buffer, BUFFER_SIZE * 4);
+    if (!waitWhileIdle()) {
+      return;
+    }
+
+    // write a fragment at a time, so each write blocks for about a period
+    read(m_period_size, &m_buffer[0]);
+    const int written = std::max(
+      0, int(write(m_output_device, &m_buffer[0], m_period_size * 4))) / 4;
+
+    // The write can't hold the lock while it blocks, so the clock may
+    // count what it already took twice until then, at most a period.
+    SYNCHRONIZED(this);
+    framesWritten(written);
+    framesDropped(m_period_size - written);
+  }
+
+
+  bool
+  OSSAudioDevice::getOutputDelay(int& frames) {
+    int bytes;
+    if (ioctl(m_output_device, SNDCTL_DSP_GETODELAY, &bytes) == -1) {
+      return false;
+    }
+    frames = bytes / 4;
+    return true;
+  }
+
+
+  void
+  OSSAudioDevice::suspendOutput() {
+    // playback starts again with the next write
+    ioctl(m_output_device, SNDCTL_DSP_RESET, 0);
+  }
+
+
+  int ADR_CALL
+  OSSAudioDevice::getPeriodSize() {
+    return m_period_size;
+  }
+
+
+  int ADR_CALL
+  OSSAudioDevice::getPeriodCount() {
+    return m_period_count;
   }
 
 
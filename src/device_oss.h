@@ -2,6 +2,7 @@
 #define DEVICE_OSS_H
 
 
+#include <vector>
 #include "audiere.h"
 #include "device_mixer.h"
 
@@ -13,15 +14,29 @@ namespace audiere {
     static OSSAudioDevice* create(const ParameterList& parameters);
 
   private:
-    OSSAudioDevice(int output_device);
+    OSSAudioDevice(
+      int output_device,
+      int rate,
+      int period_size,
+      int period_count);
     ~OSSAudioDevice();
 
   public:
     void ADR_CALL update();
     const char* ADR_CALL getName();
+    int ADR_CALL getPeriodSize();
+    int ADR_CALL getPeriodCount();
+
+  protected:
+    bool getOutputDelay(int& frames);
+    void suspendOutput();
 
   private:
     int m_output_device;
+    int m_period_size;  // frames
+    int m_period_count;
+    std::vector<s16> m_buffer;
+    bool m_buffer_locked;
   };
 
 }
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include "device_virtual.h"
+#include "debug.h"
+#include "timer.h"
+
+
+namespace audiere {
+
+  VirtualAudioDevice*
+  VirtualAudioDevice::create(const ParameterList& parameters) {
+    const int rate = parameters.getInt("rate", 44100);
+    const int period_size = parameters.getInt("period_size", 512);
+    if (rate <= 0 || period_size <= 0) {
+      return 0;
+    }
+    VirtualAudioDevice* device = new VirtualAudioDevice(
+      rate, period_size,
+      parameters.getBoolean("realtime", true));
+    device->setIdleTimeout(parameters.getInt("idle_timeout", 1000));
+    return device;
+  }
+
+
+  VirtualAudioDevice::VirtualAudioDevice(
+    int rate,
+    int period_size,
+    bool realtime)
+    : MixerDevice(rate)
+  {
+    m_period_size = period_size;
+    m_period_time = u64(period_size) * 1000000 / rate;
+    m_realtime    = realtime;
+    m_buffer.resize(period_size * 2);
+    m_deadline    = 0;
+    m_play_end    = 0;
+
+    m_stats.frames          = 0;
+    m_stats.periods         = 0;
+    m_stats.deadline_misses = 0;
+    m_stats.period_time     = int(m_period_time);
+    m_stats.cpu_time        = 0;
+    m_stats.max_cpu_time    = 0;
+  }
+
+
+  VirtualAudioDevice::~VirtualAudioDevice() {
+    ADR_GUARD("VirtualAudioDevice::~VirtualAudioDevice");
+  }
+
+
+  void ADR_CALL
+  VirtualAudioDevice::update() {
+    if (!waitWhileIdle()) {
+      return;
+    }
+
+    if (m_deadline == 0) {
+      // the first period plays once the second is due
+      m_deadline = GetMonotonicNow() + m_period_time;
+      SYNCHRONIZED(this);
+      m_play_end = m_deadline;
+    }
+
+    const u64 cpu_start = GetThreadCpuTime();
+    read(m_period_size, &m_buffer[0]);
+    const u64 cpu_time = GetThreadCpuTime() - cpu_start;
+    const u64 now = GetMonotonicNow();
+
+    {
+      // queue the period behind what is still playing, if anything
+      SYNCHRONIZED(this);
+      m_play_end = std::max(m_play_end, now) + m_period_time;
+      framesWritten(m_period_size);
+    }
+
+    bool missed = false;
+    if (m_realtime) {
+      missed = (now > m_deadline);
+      if (now > m_deadline + m_period_time) {
+        // a sound card would have underrun, so start over from here
+        m_deadline = now;
+      } else if (now < m_deadline) {
+        // Wait until the period starts playing, making room for the
+        // next.  Waking early is harmless, waking late eats into it.
+        waitForWake(int((m_deadline - now) / 1000));
+      }
+      m_deadline += m_period_time;
+    }
+
+    SYNCHRONIZED(m_stats_mutex);
+    m_stats.frames += m_period_size;
+    ++m_stats.periods;
+    if (missed) {
+      ++m_stats.deadline_misses;
+    }
+    m_stats.cpu_time += cpu_time;
+    m_stats.max_cpu_time = std::max(m_stats.max_cpu_time, int(cpu_time));
+  }
+
+
+  const char* ADR_CALL
+  VirtualAudioDevice::getName() {
+    return "virtual";
+  }
+
+
+  int ADR_CALL
+  VirtualAudioDevice::getPeriodSize() {
+    return m_period_size;
+  }
+
+
+  int ADR_CALL
+  VirtualAudioDevice::getPeriodCount() {
+    // a period is mixed while the previous one plays
+    return 2;
+  }
+
+
+  bool
+  VirtualAudioDevice::getOutputDelay(int& frames) {
+    if (!m_realtime) {
+      // there is no playback to be behind
+      return false;
+    }
+    const u64 now = GetMonotonicNow();
+    frames = (m_play_end > now ? int((m_play_end - now) * getSampleRate() / 1000000) : 0);
+    return true;
+  }
+
+
+  bool ADR_CALL
+  VirtualAudioDevice::getStats(DeviceStats& stats) {
+    // the mixer keeps the suspensions
+    MixerDevice::getStats(stats);
+
+    SYNCHRONIZED(m_stats_mutex);
+    stats.frames          = m_stats.frames;
+    stats.periods         = m_stats.periods;
+    stats.deadline_misses = m_stats.deadline_misses;
+    stats.period_time     = m_stats.period_time;
+    stats.cpu_time        = m_stats.cpu_time;
+    stats.max_cpu_time    = m_stats.max_cpu_time;
+    return true;
+  }
+
+
+  void
+  VirtualAudioDevice::suspendOutput() {
+    // nothing queued plays any more
+    m_play_end = GetMonotonicNow();
+  }
+
+
+  void
+  VirtualAudioDevice::resumeOutput() {
+    // start the schedule over
+    m_deadline = 0;
+  }
+
+}
@@ -0,0 +1,60 @@
+#ifndef DEVICE_VIRTUAL_H
+#define DEVICE_VIRTUAL_H
+
+
+#include <vector>
+#include "audiere.h"
+#include "device_mixer.h"
+#include "threads.h"
+
+
+namespace audiere {
+
+  /**
+   * Mixes like a sound card would ask it to, without one.  Every period
+   * is mixed in full and then thrown away, and the next one is due when
+   * the previous one would have finished playing.  Measures how long
+   * mixing takes, so the cost of mixing can be measured on machines
+   * without sound hardware.
+   */
+  class VirtualAudioDevice : public MixerDevice {
+  public:
+    static VirtualAudioDevice* create(const ParameterList& parameters);
+
+  private:
+    VirtualAudioDevice(int rate, int period_size, bool realtime);
+    ~VirtualAudioDevice();
+
+  public:
+    void ADR_CALL update();
+    const char* ADR_CALL getName();
+    int ADR_CALL getPeriodSize();
+    int ADR_CALL getPeriodCount();
+    bool ADR_CALL getStats(DeviceStats& stats);
+
+  protected:
+    bool getOutputDelay(int& frames);
+    void suspendOutput();
+    void resumeOutput();
+
+  private:
+    int m_period_size;  // frames
+    u64 m_period_time;  // microseconds
+    bool m_realtime;    ///< whether to wait for each period's deadline
+    std::vector<s16> m_buffer;
+
+    /// When the period being mixed is due, or 0 before the first one.
+    u64 m_deadline;
+
+    /// When everything mixed so far will have been played.  Protected
+    /// by the mixer lock.
+    u64 m_play_end;
+
+    Mutex m_stats_mutex;
+    DeviceStats m_stats;
+  };
+
+}
+
+
+#endif
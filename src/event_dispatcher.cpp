@@ -0,0 +1,193 @@
+#include "debug.h"
+#include "device.h"
+#include "event_dispatcher.h"
+#include "internal.h"
+
+
+namespace audiere {
+
+  static Mutex s_dispatcher_mutex;
+  static EventDispatcher* s_dispatcher = 0;
+
+
+  EventDispatcher& EventDispatcher::get() {
+    SYNCHRONIZED(s_dispatcher_mutex);
+    if (!s_dispatcher) {
+      s_dispatcher = new EventDispatcher();
+    }
+    return *s_dispatcher;
+  }
+
+
+  EventDispatcher::EventDispatcher() {
+    ADR_GUARD("EventDispatcher::EventDispatcher");
+
+    for (int i = 0; i < QUEUE_SIZE; ++i) {
+      m_slots[i].sequence = i;
+      m_slots[i].device   = 0;
+      m_slots[i].stream   = 0;
+      m_slots[i].reason   = StopEvent::STOP_CALLED;
+    }
+    m_tail = 0;
+    m_head = 0;
+
+    m_signalled        = 0;
+    m_dropped          = 0;
+    m_dropped_reported = 0;
+    m_application      = false;
+
+    if (!AI_CreateThread(threadRoutine, this, 2)) {
+      ADR_LOG("THREAD CREATION FAILED");
+    }
+  }
+
+
+  bool EventDispatcher::postStopEvent(
+    AbstractDevice* device,
+    OutputStream* stream,
+    StopEvent::Reason reason)
+  {
+    // Positions only ever grow, and wrap around as unsigned numbers.  A
+    // slot whose sequence is the position is free on this lap, one that
+    // is a lap behind still holds an unread event.
+    long position = AI_AtomicLoad(m_tail);
+    Slot* slot;
+    for (;;) {
+      slot = &m_slots[position & (QUEUE_SIZE - 1)];
+      const long sequence = AI_AtomicLoad(slot->sequence);
+      const long difference = long((unsigned long)sequence - (unsigned long)position);
+      if (difference == 0) {
+        const long next = long((unsigned long)position + 1);
+        const long found = AI_AtomicCompareExchange(m_tail, next, position);
+        if (found == position) {
+          break;
+        }
+        position = found;
+      } else if (difference < 0) {
+        AtomicIncrement(m_dropped);
+        return false;
+      } else {
+        // another producer took the slot first
+        position = AI_AtomicLoad(m_tail);
+      }
+    }
+
+    device->ref();
+    stream->ref();
+    slot->device = device;
+    slot->stream = stream;
+    slot->reason = reason;
+    AI_AtomicStore(slot->sequence, long((unsigned long)position + 1));
+
+    // only the first event since the consumer last looked needs to wake it
+    if (AI_AtomicExchange(m_signalled, 1) == 0) {
+      m_signal.raise();
+    }
+    return true;
+  }
+
+
+  int EventDispatcher::getDescriptor() {
+    const int descriptor = m_signal.getDescriptor();
+    if (descriptor < 0) {
+      return -1;
+    }
+
+    SYNCHRONIZED(m_dispatch_mutex);
+    if (!m_application) {
+      m_application = true;
+      // wake the thread so it can exit
+      m_signal.raise();
+    }
+    return descriptor;
+  }
+
+
+  int EventDispatcher::dispatch() {
+    SYNCHRONIZED(m_dispatch_mutex);
+    if (!m_application) {
+      return 0;
+    }
+    m_signal.clear();
+    return dispatchQueued();
+  }
+
+
+  void EventDispatcher::threadRoutine(void* arg) {
+    ADR_GUARD("EventDispatcher::threadRoutine");
+    EventDispatcher* This = static_cast<EventDispatcher*>(arg);
+    This->run();
+  }
+
+
+  void EventDispatcher::run() {
+    for (;;) {
+      m_signal.wait();
+
+      SYNCHRONIZED(m_dispatch_mutex);
+      if (m_application) {
+        // The wait may have swallowed a wakeup meant for the
+        // application, so pass it on.
+        m_signal.raise();
+        return;
+      }
+      dispatchQueued();
+    }
+  }
+
+
+  int EventDispatcher::dispatchQueued() {
+    // events posted from here on raise the signal again
+    AI_AtomicExchange(m_signalled, 0);
+
+    int count = 0;
+    Slot event;
+    while (pop(event)) {
+      StopEventPtr stop = new StopEventImpl(event.stream, event.reason);
+      event.device->processEvent(stop.get());
+      stop = 0;
+
+      event.stream->unref();
+      event.device->unref();
+      ++count;
+    }
+
+    const long dropped = AI_AtomicLoad(m_dropped);
+    if (dropped != m_dropped_reported) {
+      ADR_LOG("event queue was full, events were dropped");
+      m_dropped_reported = dropped;
+    }
+    return count;
+  }
+
+
+  bool EventDispatcher::pop(Slot& event) {
+    Slot& slot = m_slots[m_head & (QUEUE_SIZE - 1)];
+    const long next = long((unsigned long)m_head + 1);
+    if (AI_AtomicLoad(slot.sequence) != next) {
+      return false;
+    }
+
+    event.device = slot.device;
+    event.stream = slot.stream;
+    event.reason = slot.reason;
+    slot.device = 0;
+    slot.stream = 0;
+
+    // free the slot for the producers' next lap
+    AI_AtomicStore(slot.sequence, long((unsigned long)m_head + QUEUE_SIZE));
+    m_head = next;
+    return true;
+  }
+
+
+  ADR_EXPORT(int) AdrGetEventDescriptor() {
+    return EventDispatcher::get().getDescriptor();
+  }
+
+
+  ADR_EXPORT(int) AdrDispatchEvents() {
+    return EventDispatcher::get().dispatch();
+  }
+
+}
@@ -0,0 +1,107 @@
+/**
+ * @file
+ *
+ * Process-wide delivery of device events to callbacks
+ */
+
+#ifndef EVENT_DISPATCHER_H
+#define EVENT_DISPATCHER_H
+
+
+#include "audiere.h"
+#include "threads.h"
+
+
+namespace audiere {
+
+  class AbstractDevice;
+
+
+  /**
+   * Carries events from the threads that raise them to the callbacks.
+   * Posting is lock-free and doesn't allocate, so audio threads can do it
+   * while mixing.  Events wait in a fixed ring of slots; when that is
+   * full, further events are dropped and counted.
+   *
+   * Callbacks are called from a thread of the dispatcher's own, until the
+   * application asks for the descriptor.  From then on they are called
+   * by dispatch(), on whatever thread the application calls it from, and
+   * the descriptor polls readable while events are waiting.
+   *
+   * The dispatcher is created on first use and lives for the rest of the
+   * process.
+   */
+  class EventDispatcher {
+  public:
+    /// Events that can wait before new ones are dropped.
+    enum { QUEUE_SIZE = 1024 };
+
+    /// Returns the dispatcher shared by the whole library.
+    static EventDispatcher& get();
+
+    /**
+     * Queues a stop event for device's callbacks.  The event holds
+     * references to device and stream until it has been dispatched.
+     *
+     * @return  false if the queue was full and the event was dropped
+     */
+    bool postStopEvent(
+      AbstractDevice* device,
+      OutputStream* stream,
+      StopEvent::Reason reason);
+
+    /**
+     * Moves dispatching to the application and returns the descriptor to
+     * poll for events.  Returns -1, and leaves the dispatcher's thread
+     * running, if the system has no such descriptor.
+     */
+    int getDescriptor();
+
+    /**
+     * Calls the callbacks for the events waiting.  Does nothing until
+     * getDescriptor() has handed dispatching to the application.
+     *
+     * @return  number of events dispatched
+     */
+    int dispatch();
+
+  private:
+    struct Slot {
+      volatile long sequence;  ///< which lap of the ring the slot is on
+      AbstractDevice* device;
+      OutputStream* stream;
+      StopEvent::Reason reason;
+    };
+
+    EventDispatcher();
+
+    static void threadRoutine(void* arg);
+    void run();
+
+    /// Dispatches everything queued.  Expects m_dispatch_mutex.
+    int dispatchQueued();
+
+    /// Removes the oldest event.  Only the dispatching thread may call it.
+    bool pop(Slot& event);
+
+    // A bounded multi-producer queue: producers claim a position by
+    // advancing m_tail, and each slot's sequence says whether it is free
+    // for the claimed lap or holds an event for the consumer.
+    Slot m_slots[QUEUE_SIZE];
+    volatile long m_tail;
+    long m_head;            ///< next slot to pop, consumer only
+
+    volatile long m_signalled;  ///< whether m_signal was raised since the last pop
+    volatile long m_dropped;
+    long m_dropped_reported;
+
+    Signal m_signal;
+
+    Mutex m_dispatch_mutex;  ///< held while popping
+    bool m_application;      ///< whether the application dispatches
+  };
+
+}
+
+
+#endif
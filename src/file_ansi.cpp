@@ -1,6 +1,12 @@
+// ask for a 64-bit off_t on 32-bit POSIX systems
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include <stdio.h>
 #include "debug.h"
 #include "default_file.h"
+#include "utility.h"
 
 
 namespace audiere {
@@ -23,6 +29,14 @@ namespace audiere {
     }
 
     bool ADR_CALL seek(int position, SeekMode mode) {
+      return seek64(position, mode);
+    }
+
+    int ADR_CALL tell() {
+      return ClampToInt(tell64());
+    }
+
+    bool ADR_CALL seek64(s64 position, SeekMode mode) {
       int m;
       switch (mode) {
         case BEGIN:   m = SEEK_SET; break;
@@ -31,11 +45,23 @@ namespace audiere {
         default: return false;
       }
 
-      return (fseek(m_file, position, m) == 0);
+#if defined(_MSC_VER) && _MSC_VER >= 1400
+      return (_fseeki64(m_file, position, m) == 0);
+#elif defined(_MSC_VER)
+      return (position == long(position) && fseek(m_file, long(position), m) == 0);
+#else
+      return (fseeko(m_file, off_t(position), m) == 0);
+#endif
     }
 
-    int ADR_CALL tell() {
+    s64 ADR_CALL tell64() {
+#if defined(_MSC_VER) && _MSC_VER >= 1400
+      return _ftelli64(m_file);
+#elif defined(_MSC_VER)
       return ftell(m_file);
+#else
+      return ftello(m_file);
+#endif
     }
 
   private:
@@ -44,6 +70,13 @@ namespace audiere {
 
 
   ADR_EXPORT(File*) AdrOpenFile(const char* filename, bool writeable) {
+    if (!writeable) {
+      File* mapped = AdrOpenMappedFile(filename);
+      if (mapped) {
+        return mapped;
+      }
+    }
+
     FILE* file = fopen(filename, writeable ? "wb" : "rb");
     return (file ? new CFile(file) : 0);
   }
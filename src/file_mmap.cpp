@@ -0,0 +1,174 @@
+/**
+ * @file
+ *
+ * Read-only File implementation backed by a memory mapping of the whole
+ * file.  Reads become plain copies out of the page cache, and getData()
+ * lets decoders hand out pointers straight into the mapping.
+ */
+
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#ifdef WIN32
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+#endif
+#include <string.h>
+#include "debug.h"
+#include "default_file.h"
+#include "utility.h"
+
+
+namespace audiere {
+
+  class MMapFile : public RefImplementation<File> {
+  public:
+    MMapFile(const u8* data, s64 size) {
+      m_data     = data;
+      m_size     = size;
+      m_position = 0;
+    }
+
+    ~MMapFile() {
+#ifdef WIN32
+      UnmapViewOfFile(m_data);
+#else
+      munmap((void*)m_data, size_t(m_size));
+#endif
+    }
+
+    int ADR_CALL read(void* buffer, int size) {
+      ADR_ASSERT(buffer, "buffer pointer not valid");
+      ADR_ASSERT(size >= 0, "can't read negative number of bytes");
+      int real_read = int(std::min(m_size - m_position, s64(size)));
+      memcpy(buffer, m_data + m_position, real_read);
+      m_position += real_read;
+      return real_read;
+    }
+
+    bool ADR_CALL seek(int position, SeekMode mode) {
+      return seek64(position, mode);
+    }
+
+    int ADR_CALL tell() {
+      return ClampToInt(m_position);
+    }
+
+    bool ADR_CALL seek64(s64 position, SeekMode mode) {
+      s64 real_pos;
+      switch (mode) {
+        case BEGIN:   real_pos = position;              break;
+        case CURRENT: real_pos = m_position + position; break;
+        case END:     real_pos = m_size + position;     break;
+        default:      return false;
+      }
+
+      if (real_pos < 0 || real_pos > m_size) {
+        return false;
+      }
+      m_position = real_pos;
+      return true;
+    }
+
+    s64 ADR_CALL tell64() {
+      return m_position;
+    }
+
+    s64 ADR_CALL getData(const void*& data) {
+      data = m_data;
+      return m_size;
+    }
+
+    void ADR_CALL advise(AccessHint hint) {
+#if !defined(WIN32) && defined(MADV_SEQUENTIAL)
+      int advice;
+      switch (hint) {
+        case ACCESS_SEQUENTIAL: advice = MADV_SEQUENTIAL; break;
+        case ACCESS_RANDOM:     advice = MADV_RANDOM;     break;
+        default:                advice = MADV_NORMAL;     break;
+      }
+      madvise((void*)m_data, size_t(m_size), advice);
+#endif
+    }
+
+  private:
+    const u8* m_data;
+    s64 m_size;
+    s64 m_position;
+  };
+
+
+  ADR_EXPORT(File*) AdrOpenMappedFile(const char* filename) {
+    ADR_GUARD("AdrOpenMappedFile");
+    if (!filename) {
+      return 0;
+    }
+
+#ifdef WIN32
+
+    HANDLE file = CreateFileA(
+      filename, GENERIC_READ, FILE_SHARE_READ, 0,
+      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+      return 0;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0 ||
+        s64(size_t(file_size.QuadPart)) != file_size.QuadPart)
+    {
+      CloseHandle(file);
+      return 0;
+    }
+    s64 size = file_size.QuadPart;
+
+    HANDLE mapping = CreateFileMapping(file, 0, PAGE_READONLY, 0, 0, 0);
+    CloseHandle(file);
+    if (!mapping) {
+      return 0;
+    }
+
+    // the view keeps the mapping object alive
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!data) {
+      return 0;
+    }
+
+#else
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+      return 0;
+    }
+
+    // empty and special files can't be mapped, and neither can files
+    // larger than the address space
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+        st.st_size == 0 || s64(size_t(st.st_size)) != s64(st.st_size))
+    {
+      close(fd);
+      return 0;
+    }
+    s64 size = st.st_size;
+
+    // the mapping stays valid after the descriptor is closed
+    void* data = mmap(0, size_t(size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+      ADR_LOG("mmap() failed");
+      return 0;
+    }
+
+#endif
+
+    return new MMapFile((const u8*)data, size);
+  }
+
+}
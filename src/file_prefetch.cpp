@@ -0,0 +1,160 @@
+/**
+ * @file
+ *
+ * File wrapper that reads ahead of its reader in large blocks on the
+ * I/O scheduler's thread, so that streaming decoders are served from
+ * memory instead of issuing small blocking reads.
+ */
+
+#include "debug.h"
+#include "internal.h"
+#include "io_scheduler.h"
+#include "read_ahead.h"
+#include "utility.h"
+
+
+namespace audiere {
+
+  class PrefetchFile : public RefImplementation<File>, public ReadAheadBuffer {
+  public:
+    enum { DEFAULT_BLOCK_SIZE = 64 * 1024 };
+
+    PrefetchFile(File* file, int block_size) {
+      m_file       = file;
+      m_size       = GetFileLength(file);
+      m_position   = 0;
+      m_read_ahead = true;
+
+      initBuffers(m_size, block_size, 1, block_size);
+    }
+
+    int ADR_CALL read(void* buffer, int size) {
+      ADR_ASSERT(buffer, "buffer pointer not valid");
+      ADR_ASSERT(size >= 0, "can't read negative number of bytes");
+
+      SYNCHRONIZED(m_mutex);
+      return readBuffered(m_position, size, buffer, m_read_ahead);
+    }
+
+    bool ADR_CALL seek(int position, SeekMode mode) {
+      return seek64(position, mode);
+    }
+
+    int ADR_CALL tell() {
+      return ClampToInt(tell64());
+    }
+
+    bool ADR_CALL seek64(s64 position, SeekMode mode) {
+      SYNCHRONIZED(m_mutex);
+
+      s64 real_pos;
+      switch (mode) {
+        case BEGIN:   real_pos = position;              break;
+        case CURRENT: real_pos = m_position + position; break;
+        case END:     real_pos = m_size + position;     break;
+        default:      return false;
+      }
+
+      if (real_pos < 0 || real_pos > m_size) {
+        return false;
+      }
+      m_position = real_pos;
+      return true;
+    }
+
+    s64 ADR_CALL tell64() {
+      SYNCHRONIZED(m_mutex);
+      return m_position;
+    }
+
+    void ADR_CALL advise(AccessHint hint) {
+      {
+        SYNCHRONIZED(m_mutex);
+        m_read_ahead = (hint != ACCESS_RANDOM);
+      }
+      SYNCHRONIZED(m_io_mutex);
+      m_file->advise(hint);
+    }
+
+    File* getFile() {
+      return m_file.get();
+    }
+
+  protected:
+    int fillBuffer(s64 offset, void* buffer) {
+      SYNCHRONIZED(m_io_mutex);
+      if (!m_file->seek64(offset, BEGIN)) {
+        return 0;
+      }
+      return m_file->read(buffer, getBufferLength());
+    }
+
+    RefCounted* createJob(int i, s64 offset);
+
+    void submitJob(RefCounted* job) {
+      IOScheduler::get().submit(static_cast<IORequest*>(job));
+    }
+
+  private:
+    FilePtr m_file;
+    s64 m_size;
+
+    Mutex m_io_mutex;  ///< serializes access to m_file
+
+    Mutex m_mutex;     ///< protects the reader's state below
+    s64 m_position;
+    bool m_read_ahead;
+  };
+
+
+  class BlockRead : public IORequest {
+  public:
+    BlockRead(PrefetchFile* file, int block, s64 offset) {
+      m_file   = file;
+      m_block  = block;
+      m_offset = offset;
+    }
+
+    File* getFile() {
+      return m_file->getFile();
+    }
+
+    s64 getOffset() {
+      return m_offset;
+    }
+
+    void run() {
+      m_file->fillQueued(m_block, m_offset);
+    }
+
+  private:
+    RefPtr<PrefetchFile> m_file;
+    int m_block;
+    s64 m_offset;
+  };
+
+
+  RefCounted* PrefetchFile::createJob(int i, s64 offset) {
+    return new BlockRead(this, i, offset);
+  }
+
+
+  ADR_EXPORT(File*) AdrOpenPrefetchFile(File* file, int block_size) {
+    ADR_GUARD("AdrOpenPrefetchFile");
+    if (!file) {
+      return 0;
+    }
+
+    // contents that are already in memory gain nothing from read-ahead
+    const void* data;
+    if (file->getData(data)) {
+      return file;
+    }
+
+    if (block_size <= 0) {
+      block_size = PrefetchFile::DEFAULT_BLOCK_SIZE;
+    }
+    return new PrefetchFile(file, block_size);
+  }
+
+}
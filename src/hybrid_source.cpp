@@ -0,0 +1,175 @@
+/**
+ * @file
+ *
+ * Source for long sounds that keeps only their beginning in memory.  The
+ * beginning is played immediately while the rest is decoded in the
+ * background, a chunk ahead of the reader.
+ */
+
+#include <string.h>
+#include <vector>
+#include "basic_source.h"
+#include "debug.h"
+#include "hybrid_source.h"
+#include "read_ahead.h"
+#include "threads.h"
+#include "utility.h"
+#include "worker_pool.h"
+
+
+namespace audiere {
+
+  class HybridSource : public BasicSource, public ReadAheadBuffer {
+  public:
+    /// Length of each chunk of the tail decoded ahead of the reader.
+    enum { CHUNK_MILLISECONDS = 250 };
+
+    HybridSource(SampleSource* source, int head_length) {
+      m_source = source;
+      m_source->setRepeat(false);
+      m_source->getFormat(m_channel_count, m_sample_rate, m_sample_format);
+      m_frame_size = m_channel_count * GetSampleSize(m_sample_format);
+      m_length     = m_source->getLength64();
+      m_position   = 0;
+
+      // decode the head now, so that playback can start from it
+      m_head_length = int(std::min(s64(head_length), m_length));
+      m_source->setPosition64(0);
+      m_head.resize(m_head_length * m_frame_size);
+      if (m_head_length) {
+        m_head_length = m_source->read(m_head_length, &m_head[0]);
+      }
+
+      const int chunk_length = m_sample_rate * CHUNK_MILLISECONDS / 1000;
+      initBuffers(m_length, chunk_length, m_frame_size, 1);
+
+      m_decoder_text = std::string("hybrid:") + m_source->getDecoder();
+    }
+
+    void ADR_CALL getFormat(
+      int& channel_count,
+      int& sample_rate,
+      SampleFormat& sample_format)
+    {
+      channel_count = m_channel_count;
+      sample_rate   = m_sample_rate;
+      sample_format = m_sample_format;
+    }
+
+    int doRead(int frame_count, void* buffer) {
+      u8* out = (u8*)buffer;
+      int total = 0;
+
+      // the head never changes, so it's served straight from memory
+      if (m_position < m_head_length) {
+        const int count = std::min(frame_count, int(m_head_length - m_position));
+        memcpy(out, &m_head[int(m_position) * m_frame_size],
+               count * m_frame_size);
+        total      += count;
+        m_position += count;
+      }
+
+      if (m_position < m_head_length) {
+        // get the tail going before the head runs out
+        readAhead(m_head_length, m_position);
+      } else if (total < frame_count) {
+        total += readBuffered(m_position, frame_count - total,
+                              out + total * m_frame_size, true);
+      }
+      return total;
+    }
+
+    void ADR_CALL reset() {
+      setPosition64(0);
+    }
+
+    bool ADR_CALL isSeekable() {
+      return true;
+    }
+
+    s64 ADR_CALL getLength64() {
+      return m_length;
+    }
+
+    void ADR_CALL setPosition64(s64 position) {
+      m_position = clamp(s64(0), position, m_length);
+      readAhead(std::max(m_position, s64(m_head_length)), m_position);
+    }
+
+    s64 ADR_CALL getPosition64() {
+      return m_position;
+    }
+
+  protected:
+    int fillBuffer(s64 start, void* buffer) {
+      SYNCHRONIZED(m_source_mutex);
+      if (m_source->getPosition64() != start) {
+        m_source->setPosition64(start);
+      }
+      return m_source->read(getBufferLength(), buffer);
+    }
+
+    RefCounted* createJob(int i, s64 start);
+
+    void submitJob(RefCounted* job) {
+      WorkerPool::get().submit(static_cast<WorkerJob*>(job));
+    }
+
+    bool cancelJob(RefCounted* job) {
+      // If the pool hasn't got to the chunk, e.g. because it's busy with
+      // long loads, the reader reads it instead.
+      return WorkerPool::get().remove(static_cast<WorkerJob*>(job));
+    }
+
+  private:
+    SampleSourcePtr m_source;
+    int m_channel_count;
+    int m_sample_rate;
+    SampleFormat m_sample_format;
+    int m_frame_size;
+    s64 m_length;
+
+    std::vector<u8> m_head;
+    int m_head_length;
+
+    /// Only touched by the reader.
+    s64 m_position;
+
+    Mutex m_source_mutex;  ///< serializes access to m_source
+  };
+
+
+  class ChunkRead : public WorkerJob {
+  public:
+    ChunkRead(HybridSource* source, int chunk, s64 start) {
+      m_source = source;
+      m_chunk  = chunk;
+      m_start  = start;
+    }
+
+    void run() {
+      m_source->fillQueued(m_chunk, m_start);
+    }
+
+  private:
+    RefPtr<HybridSource> m_source;
+    int m_chunk;
+    s64 m_start;
+  };
+
+
+  RefCounted* HybridSource::createJob(int i, s64 start) {
+    return new ChunkRead(this, i, start);
+  }
+
+
+  SampleSource* CreateHybridSource(SampleSource* source, int head_length) {
+    ADR_GUARD("CreateHybridSource");
+    if (!source || !source->isSeekable()) {
+      return 0;
+    }
+
+    return new HybridSource(source, head_length);
+  }
+
+}
@@ -0,0 +1,22 @@
+#ifndef HYBRID_SOURCE_H
+#define HYBRID_SOURCE_H
+
+
+#include "audiere.h"
+
+
+namespace audiere {
+
+  /**
+   * Creates a source that decodes the first head_length frames of source
+   * into memory right away and serves them from there.  From the first
+   * read on, the rest of source is decoded ahead of the reader on the
+   * worker pool.  source must be seekable, and is only used by the
+   * returned source from then on.
+   */
+  SampleSource* CreateHybridSource(SampleSource* source, int head_length);
+
+}
+
+
+#endif
@@ -116,6 +116,189 @@ namespace audiere {
   }
 
 
+  /// Number of bytes read from the start of a file when sniffing its format.
+  static const int SNIFF_SIZE = 4096;
+
+
+  /**
+   * Returns the length in bytes of the MPEG audio frame whose header is
+   * at h, or 0 if h is not a plausible frame header.  Free-format streams
+   * are rejected since their frame length can't be computed from the
+   * header alone.
+   */
+  static int GetMPEGFrameLength(const u8* h) {
+    static const int bitrates[2][3][15] = {
+      { // MPEG-1, layers I, II, III
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+        { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+        { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 },
+      },
+      { // MPEG-2 and 2.5, layers I, II, III
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+        { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160 },
+        { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160 },
+      },
+    };
+    static const int sample_rates[3] = { 44100, 48000, 32000 };
+
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) {
+      return 0;
+    }
+
+    int version       = (h[1] >> 3) & 3;  // 0 = 2.5, 1 = reserved, 2 = 2, 3 = 1
+    int layer         = (h[1] >> 1) & 3;  // 0 = reserved, 1 = III, 2 = II, 3 = I
+    int bitrate_index = (h[2] >> 4) & 15;
+    int rate_index    = (h[2] >> 2) & 3;
+    int padding       = (h[2] >> 1) & 1;
+    if (version == 1 || layer == 0 || bitrate_index == 0 ||
+        bitrate_index == 15 || rate_index == 3)
+    {
+      return 0;
+    }
+
+    bool mpeg1 = (version == 3);
+    int bitrate = bitrates[mpeg1 ? 0 : 1][3 - layer][bitrate_index] * 1000;
+    int sample_rate = sample_rates[rate_index];
+    if (version == 2) {
+      sample_rate /= 2;
+    } else if (version == 0) {
+      sample_rate /= 4;
+    }
+
+    if (layer == 3) {
+      return (12 * bitrate / sample_rate + padding) * 4;
+    } else if (layer == 1 && !mpeg1) {
+      return 72 * bitrate / sample_rate + padding;
+    } else {
+      return 144 * bitrate / sample_rate + padding;
+    }
+  }
+
+
+  /**
+   * A lone sync word is common in arbitrary data, so only report MPEG
+   * audio if the frame at the start of the buffer is followed by another
+   * frame of the same version and layer.
+   */
+  static bool IsMPEGAudio(const u8* data, int size) {
+    int length = GetMPEGFrameLength(data);
+    if (length <= 0) {
+      return false;
+    }
+    if (length + 4 > size) {
+      // the next frame is beyond what was read: trust the single header
+      return true;
+    }
+    const u8* next = data + length;
+    return (GetMPEGFrameLength(next) > 0 &&
+            (next[1] & 0xFE) == (data[1] & 0xFE));
+  }
+
+
+  static bool IsMODSignature(const u8* sig) {
+    static const char* signatures[] = {
+      "M.K.", "M!K!", "M&K!", "N.T.", "FLT4", "FLT8", "CD81", "OKTA", "OCTA",
+    };
+    for (int i = 0; i < int(sizeof(signatures) / sizeof(*signatures)); ++i) {
+      if (memcmp(sig, signatures[i], 4) == 0) {
+        return true;
+      }
+    }
+
+    // "xCHN", "xxCH", and "xxCN" with a decimal channel count
+    bool d0 = (sig[0] >= '0' && sig[0] <= '9');
+    bool d1 = (sig[1] >= '0' && sig[1] <= '9');
+    return ((d0 && memcmp(sig + 1, "CHN", 3) == 0) ||
+            (d0 && d1 && memcmp(sig + 2, "CH", 2) == 0) ||
+            (d0 && d1 && memcmp(sig + 2, "CN", 2) == 0));
+  }
+
+
+  /**
+   * Determines a file's format from its leading bytes.  Reads at most
+   * SNIFF_SIZE bytes (plus an ID3v2 tag, if present) and leaves the file
+   * positioned at the beginning.
+   *
+   * @return  the detected format, or FF_AUTODETECT if nothing matched
+   */
+  static FileFormat SniffFormat(const FilePtr& file) {
+    ADR_GUARD("SniffFormat");
+
+    u8 header[SNIFF_SIZE];
+    int size = file->read(header, SNIFF_SIZE);
+
+    // ID3v2 tags precede MP3 (and occasionally FLAC) streams, and can be
+    // arbitrarily large.  Look past them at what follows.
+    int offset = 0;
+    bool id3 = (size >= 10 && memcmp(header, "ID3", 3) == 0);
+    if (id3) {
+      offset = 10 + ((header[6] & 0x7F) << 21) +
+                    ((header[7] & 0x7F) << 14) +
+                    ((header[8] & 0x7F) << 7) +
+                     (header[9] & 0x7F);
+      if (header[5] & 0x10) {  // footer present
+        offset += 10;
+      }
+      if (offset + 4 > size) {
+        if (!file->seek(offset, File::BEGIN)) {
+          file->seek(0, File::BEGIN);
+          return FF_MP3;
+        }
+        size = file->read(header, SNIFF_SIZE);
+        offset = 0;
+      }
+    }
+    file->seek(0, File::BEGIN);
+
+    const u8* data = header + offset;
+    size -= offset;
+
+    if (size >= 4 && memcmp(data, "fLaC", 4) == 0) {
+      return FF_FLAC;
+    }
+    if (id3) {
+      // anything after an ID3v2 tag that isn't FLAC is presumably MP3
+      return FF_MP3;
+    }
+
+    if (size >= 12 && memcmp(data, "RIFF", 4) == 0 &&
+        memcmp(data + 8, "WAVE", 4) == 0)
+    {
+      return FF_WAV;
+    }
+    if (size >= 12 && memcmp(data, "FORM", 4) == 0 &&
+        memcmp(data + 8, "AIFF", 4) == 0)
+    {
+      return FF_AIFF;
+    }
+
+    // the first Ogg page carries the codec identification header
+    if (size >= 36 && memcmp(data, "OggS", 4) == 0) {
+      if (memcmp(data + 28, "\x01vorbis", 7) == 0) {
+        return FF_OGG;
+      }
+      if (memcmp(data + 28, "Speex   ", 8) == 0) {
+        return FF_SPEEX;
+      }
+      return FF_AUTODETECT;
+    }
+
+    if ((size >= 4 && memcmp(data, "IMPM", 4) == 0) ||
+        (size >= 17 && memcmp(data, "Extended Module: ", 17) == 0) ||
+        (size >= 48 && memcmp(data + 44, "SCRM", 4) == 0) ||
+        (size >= 1084 && IsMODSignature(data + 1080)))
+    {
+      return FF_MOD;
+    }
+
+    if (size >= 4 && IsMPEGAudio(data, size)) {
+      return FF_MP3;
+    }
+
+    return FF_AUTODETECT;
+  }
+
+
   /**
    * The internal implementation of OpenSampleSource.
    *
@@ -134,23 +317,31 @@ namespace audiere {
     switch (file_format) {
       case FF_AUTODETECT:
         
+      {
+        // the file's contents are the most reliable indication
+        FileFormat sniffed = SniffFormat(file);
+        if (sniffed != FF_AUTODETECT) {
+          TRY_OPEN(sniffed);
+        }
+
         // if filename is available, use it as a hint
-        if (filename) {
-          FileFormat format = GuessFormat(filename);
-          if (format != FF_AUTODETECT) {
-            TRY_OPEN(format);
-          }
+        FileFormat guessed = (filename ? GuessFormat(filename) : FF_AUTODETECT);
+        if (guessed != FF_AUTODETECT && guessed != sniffed) {
+          TRY_OPEN(guessed);
         }
 
-        // autodetect otherwise, in decreasing order of possibility of failure
-        TRY_OPEN(FF_AIFF);
-        TRY_OPEN(FF_WAV);
-        TRY_OPEN(FF_OGG);
-        TRY_OPEN(FF_FLAC);
-        TRY_OPEN(FF_SPEEX);
-        TRY_OPEN(FF_MP3);
-        TRY_OPEN(FF_MOD);
+        // as a last resort, try every decoder in decreasing order of
+        // possibility of failure
+        static const FileFormat formats[] = {
+          FF_AIFF, FF_WAV, FF_OGG, FF_FLAC, FF_SPEEX, FF_MP3, FF_MOD,
+        };
+        for (int i = 0; i < int(sizeof(formats) / sizeof(*formats)); ++i) {
+          if (formats[i] != sniffed && formats[i] != guessed) {
+            TRY_OPEN(formats[i]);
+          }
+        }
         return 0;
+      }
 
 #ifndef NO_DUMB
       case FF_MOD:
@@ -38,6 +38,7 @@ namespace audiere {
     ADR_GUARD("AIFFInputStream::initialize");
 
     m_file = file;
+    m_file->advise(File::ACCESS_SEQUENTIAL);
 
     u8 header[12];
     if (file->read(header, 12) != 12) {
@@ -82,7 +83,7 @@ namespace audiere {
       return 0;
     }
 
-    const int frames_to_read = std::min(frame_count, m_frames_left_in_chunk);
+    const int frames_to_read = int(std::min(s64(frame_count), m_frames_left_in_chunk));
     const int frame_size = m_channel_count * GetSampleSize(m_sample_format);
     const int bytes_to_read = frames_to_read * frame_size;
 
@@ -115,7 +116,7 @@ namespace audiere {
   AIFFInputStream::reset() {
     // seek to the beginning of the data chunk
     m_frames_left_in_chunk = m_data_chunk_length;
-    if (!m_file->seek(m_data_chunk_location, File::BEGIN)) {
+    if (!m_file->seek64(m_data_chunk_location, File::BEGIN)) {
       ADR_LOG("Seek in AIFFInputStream::reset");
     }
   }
@@ -127,22 +128,22 @@ namespace audiere {
   }
 
 
-  int
-  AIFFInputStream::getLength() {
+  s64
+  AIFFInputStream::getLength64() {
     return m_data_chunk_length;
   }
 
 
   void
-  AIFFInputStream::setPosition(int position) {
+  AIFFInputStream::setPosition64(s64 position) {
     int frame_size = m_channel_count * GetSampleSize(m_sample_format);
     m_frames_left_in_chunk = m_data_chunk_length - position;
-    m_file->seek(m_data_chunk_location + position * frame_size, File::BEGIN);
+    m_file->seek64(m_data_chunk_location + position * frame_size, File::BEGIN);
   }
 
 
-  int
-  AIFFInputStream::getPosition() {
+  s64
+  AIFFInputStream::getPosition64() {
     return m_data_chunk_length - m_frames_left_in_chunk;
   }
 
@@ -255,7 +256,7 @@ namespace audiere {
         // calculate the frame size so we can truncate the data chunk
         int frame_size = m_channel_count * GetSampleSize(m_sample_format);
 
-        m_data_chunk_location  = m_file->tell();
+        m_data_chunk_location  = m_file->tell64();
         m_data_chunk_length    = (chunk_length - 8) / frame_size;
         m_frames_left_in_chunk = m_data_chunk_length;
         return true;
@@ -282,8 +283,8 @@ namespace audiere {
 
 
   bool
-  AIFFInputStream::skipBytes(int size) {
-    return m_file->seek(size, File::CURRENT);
+  AIFFInputStream::skipBytes(s64 size) {
+    return m_file->seek64(size, File::CURRENT);
   }
 
 }
@@ -23,14 +23,14 @@ namespace audiere {
     void ADR_CALL reset();
 
     bool ADR_CALL isSeekable();
-    int  ADR_CALL getLength();
-    void ADR_CALL setPosition(int position);
-    int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
 
   private:
     bool findCommonChunk();
     bool findSoundChunk();
-    bool skipBytes(int size);
+    bool skipBytes(s64 size);
 
   private:
     FilePtr m_file;
@@ -41,10 +41,10 @@ namespace audiere {
     SampleFormat m_sample_format;
 
     // from data chunk
-    int m_data_chunk_location; // bytes
-    int m_data_chunk_length;   // in frames
+    s64 m_data_chunk_location; // bytes
+    s64 m_data_chunk_length;   // in frames
 
-    int m_frames_left_in_chunk;
+    s64 m_frames_left_in_chunk;
   };
 
 }
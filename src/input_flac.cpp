@@ -9,7 +9,9 @@
 
 namespace audiere {
 
-  FLACInputStream::FLACInputStream() {
+  FLACInputStream::FLACInputStream()
+    : m_buffer(65536)
+  {
     m_decoder = 0;
 
     m_channel_count = 0;
@@ -35,6 +37,7 @@ namespace audiere {
   bool
   FLACInputStream::initialize(FilePtr file) {
     m_file = file;
+    m_file->advise(File::ACCESS_SEQUENTIAL);
 
     // initialize the decoder
     m_decoder = FLAC__stream_decoder_new();
@@ -144,6 +147,29 @@ namespace audiere {
   }
 
 
+  int
+  FLACInputStream::acquireBlock(int frame_count, const void*& block) {
+    const int frame_size = m_channel_count * GetSampleSize(m_sample_format);
+
+    if (m_buffer.getSize() < frame_size) {
+      if (!FLAC__stream_decoder_process_single(m_decoder)) {
+        block = 0;
+        return 0;
+      }
+    }
+
+    // frames that straddle the end of the ring have to go through read()
+    return std::min(frame_count, m_buffer.peek(block) / frame_size);
+  }
+
+
+  void
+  FLACInputStream::releaseBlock(int frame_count) {
+    const int frame_size = m_channel_count * GetSampleSize(m_sample_format);
+    m_buffer.consume(frame_count * frame_size);
+  }
+
+
   void
   FLACInputStream::reset() {
     m_file->seek(0, File::BEGIN);
@@ -159,22 +185,22 @@ namespace audiere {
   }
 
 
-  int
-  FLACInputStream::getLength() {
+  s64
+  FLACInputStream::getLength64() {
     return m_length;
   }
 
 
   void
-  FLACInputStream::setPosition(int position) {
+  FLACInputStream::setPosition64(s64 position) {
     if (FLAC__stream_decoder_seek_absolute(m_decoder, position)) {
       m_position = position;
     }
   }
 
 
-  int
-  FLACInputStream::getPosition() {
+  s64
+  FLACInputStream::getPosition64() {
     int bytes_per_frame = m_channel_count * GetSampleSize(m_sample_format);
     return m_position - (m_buffer.getSize() / bytes_per_frame);
   }
@@ -190,11 +216,17 @@ namespace audiere {
     int bytes_per_sample = frame->header.bits_per_sample / 8;
     int total_size = channel_count * samples_per_channel * bytes_per_sample;
 
-    m_multiplexer.ensureSize(total_size);
+    // interleave straight into the ring if the frame fits without
+    // wrapping, otherwise go through the multiplexer buffer
+    void* target;
+    if (m_buffer.getWriteSpan(target) < total_size) {
+      m_multiplexer.ensureSize(total_size);
+      target = m_multiplexer.get();
+    }
 
     // do the multiplexing/interleaving
     if (bytes_per_sample == 1) {
-      u8* out = (u8*)m_multiplexer.get();
+      u8* out = (u8*)target;
       for (int s = 0; s < samples_per_channel; ++s) {
         for (int c = 0; c < channel_count; ++c) {
           // is this right?
@@ -202,7 +234,7 @@ namespace audiere {
         }
       }
     } else if (bytes_per_sample == 2) {
-      s16* out = (s16*)m_multiplexer.get();
+      s16* out = (s16*)target;
       for (int s = 0; s < samples_per_channel; ++s) {
         for (int c = 0; c < channel_count; ++c) {
           *out++ = (s16)buffer[c][s];
@@ -212,7 +244,11 @@ namespace audiere {
       return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
     }
 
-    m_buffer.write(m_multiplexer.get(), total_size);
+    if (target == m_multiplexer.get()) {
+      m_buffer.write(target, total_size);
+    } else {
+      m_buffer.commit(total_size);
+    }
     m_position += samples_per_channel;
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
   }
@@ -238,7 +274,7 @@ namespace audiere {
     FLAC__uint64 absolute_byte_offset,
     void* client_data)
   {
-    if (getFile(client_data)->seek(static_cast<int>(absolute_byte_offset), File::BEGIN)) {
+    if (getFile(client_data)->seek64(s64(absolute_byte_offset), File::BEGIN)) {
       return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
     } else {
       return FLAC__STREAM_DECODER_SEEK_STATUS_ERROR;
@@ -251,7 +287,7 @@ namespace audiere {
     FLAC__uint64* absolute_byte_offset,
     void* client_data)
   {
-    *absolute_byte_offset = getFile(client_data)->tell();
+    *absolute_byte_offset = getFile(client_data)->tell64();
     return FLAC__STREAM_DECODER_TELL_STATUS_OK;
   }
 
@@ -271,7 +307,7 @@ namespace audiere {
     void* client_data)
   {
     File* file = getFile(client_data);
-    return (file->tell() == GetFileLength(file));
+    return (file->tell64() == GetFileLength(file));
   }
 
 
@@ -292,7 +328,7 @@ namespace audiere {
   {
     if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO) {
       FLAC__uint64 length = metadata->data.stream_info.total_samples;
-      getStream(client_data)->m_length = static_cast<int>(length);
+      getStream(client_data)->m_length = s64(length);
     }
   }
 
@@ -24,10 +24,13 @@ namespace audiere {
     int doRead(int frame_count, void* samples);
     void ADR_CALL reset();
 
+    int  ADR_CALL acquireBlock(int frame_count, const void*& block);
+    void ADR_CALL releaseBlock(int frame_count);
+
     bool ADR_CALL isSeekable();
-    int  ADR_CALL getLength();
-    void ADR_CALL setPosition(int position);
-    int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
 
   private:
     FLAC__StreamDecoderWriteStatus write(
@@ -87,14 +90,14 @@ namespace audiere {
      * this stores a queue of sample data coming from FLAC and being read by
      * the client of the stream
      */
-    QueueBuffer m_buffer;
+    RingBuffer m_buffer;
 
     int m_channel_count;
     int m_sample_rate;
     SampleFormat m_sample_format;
 
-    int m_length;
-    int m_position;
+    s64 m_length;
+    s64 m_position;
   };
 
 }
@@ -16,7 +16,9 @@ namespace audiere {
   static const int ID3v2_HEADER_SIZE = 10;
 
 
-  MP3InputStream::MP3InputStream() {
+  MP3InputStream::MP3InputStream()
+    : m_buffer(MPAUDEC_MAX_AUDIO_FRAME_SIZE * 2)
+  {
     m_eof = false;
 
     m_channel_count = 2;
@@ -48,6 +50,7 @@ namespace audiere {
   bool
   MP3InputStream::initialize(FilePtr file) {
     m_file = file;
+    m_file->advise(File::ACCESS_SEQUENTIAL);
     m_seekable = m_file->seek(0, File::END);
     readID3v1Tags();
     readID3v2Tags();
@@ -78,7 +81,7 @@ namespace audiere {
           return false;
         if (!m_eof)
           m_frame_sizes.push_back(m_context->frame_size);
-          int frame_offset = m_file->tell() -
+          s64 frame_offset = m_file->tell64() -
                              (m_input_length - m_input_position) -
                              m_context->coded_frame_size;
           m_frame_offsets.push_back(frame_offset);
@@ -96,16 +99,16 @@ namespace audiere {
     return m_seekable;
   }
 
-  int
-  MP3InputStream::getPosition() {
+  s64
+  MP3InputStream::getPosition64() {
      return m_position;
   }
 
   void
-  MP3InputStream::setPosition(int position) {
+  MP3InputStream::setPosition64(s64 position) {
     if (!m_seekable || position > m_length)
       return;
-    int scan_position = 0;
+    s64 scan_position = 0;
     int target_frame = 0;
     int frame_count = m_frame_sizes.size();
     while (target_frame < frame_count) {
@@ -123,7 +126,7 @@ namespace audiere {
     const int MAX_FRAME_DEPENDENCY = 10;
     target_frame = std::max(0, target_frame - MAX_FRAME_DEPENDENCY);
     reset();
-    m_file->seek(m_frame_offsets[target_frame], File::BEGIN);
+    m_file->seek64(m_frame_offsets[target_frame], File::BEGIN);
     int i;
     for (i = 0; i < target_frame; i++) {
       m_position += m_frame_sizes[i];
@@ -132,7 +135,7 @@ namespace audiere {
       reset();
       return;
     }
-    int frames_to_consume = position - m_position; // PCM frames now
+    int frames_to_consume = int(position - m_position); // PCM frames now
     if (frames_to_consume > 0) {
       u8 *buf = new u8[frames_to_consume * GetFrameSize(this)];
       doRead(frames_to_consume, buf);
@@ -140,8 +143,8 @@ namespace audiere {
     }
   }
 
-  int
-  MP3InputStream::getLength() {
+  s64
+  MP3InputStream::getLength64() {
     return m_length;
   }
 
@@ -196,6 +199,29 @@ namespace audiere {
   }
 
 
+  int
+  MP3InputStream::acquireBlock(int frame_count, const void*& block) {
+    const int frame_size = GetFrameSize(this);
+
+    if (m_buffer.getSize() < frame_size) {
+      if (!decodeFrame() || m_eof) {
+        block = 0;
+        return 0;
+      }
+    }
+
+    // frames that straddle the end of the ring have to go through read()
+    return std::min(frame_count, m_buffer.peek(block) / frame_size);
+  }
+
+
+  void
+  MP3InputStream::releaseBlock(int frame_count) {
+    m_buffer.consume(frame_count * GetFrameSize(this));
+    m_position += frame_count;
+  }
+
+
   void
   MP3InputStream::reset() {
     ADR_GUARD("MP3InputStream::reset");
@@ -217,6 +243,14 @@ namespace audiere {
 
   bool
   MP3InputStream::decodeFrame() {
+    // decode straight into the ring if it has room for a whole frame
+    // without wrapping, otherwise go through m_decode_buffer
+    void* span;
+    u8* output = m_decode_buffer;
+    if (m_buffer.getWriteSpan(span) >= MPAUDEC_MAX_AUDIO_FRAME_SIZE) {
+      output = (u8*)span;
+    }
+
     int output_size = 0;
     while (output_size == 0) {
       if (m_input_position == m_input_length) {
@@ -252,7 +286,7 @@ namespace audiere {
       }
 
       int rv = mpaudec_decode_frame(
-          m_context, (s16*)m_decode_buffer,
+          m_context, (s16*)output,
           &output_size,
           (unsigned char*)m_input_buffer + m_input_position,
           m_input_length - m_input_position);
@@ -288,9 +322,13 @@ namespace audiere {
         // Couldn't decode this frame.  Too bad, already lost it.
         // This should only happen when seeking.
         output_size = m_context->frame_size;
-        memset(m_decode_buffer, 0, output_size * GetFrameSize(this));
+        memset(output, 0, output_size * GetFrameSize(this));
+      }
+      if (output == m_decode_buffer) {
+        m_buffer.write(output, output_size);
+      } else {
+        m_buffer.commit(output_size);
       }
-      m_buffer.write(m_decode_buffer, output_size);
     }
     return true;
   }
@@ -27,10 +27,13 @@ namespace audiere {
     int doRead(int frame_count, void* samples);
     void ADR_CALL reset();
 
+    int  ADR_CALL acquireBlock(int frame_count, const void*& block);
+    void ADR_CALL releaseBlock(int frame_count);
+
     bool ADR_CALL isSeekable();
-    int  ADR_CALL getLength();
-    void ADR_CALL setPosition(int position);
-    int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
 
 
   private:
@@ -58,7 +61,7 @@ namespace audiere {
     int m_sample_rate;
     SampleFormat m_sample_format;
 
-    QueueBuffer m_buffer;
+    RingBuffer m_buffer;
 
     enum { INPUT_BUFFER_SIZE = 4096 };
     u8 m_input_buffer[INPUT_BUFFER_SIZE];
@@ -68,10 +71,10 @@ namespace audiere {
     bool m_first_frame;
 
     bool m_seekable;
-    int m_length;
-    int m_position;
+    s64 m_length;
+    s64 m_position;
     std::vector<int> m_frame_sizes;
-    std::vector<int> m_frame_offsets;
+    std::vector<s64> m_frame_offsets;
   };
 
 }
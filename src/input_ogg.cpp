@@ -32,6 +32,7 @@ namespace audiere {
   bool
   OGGInputStream::initialize(FilePtr file) {
     m_file = file;
+    m_file->advise(File::ACCESS_SEQUENTIAL);
 
     // custom ogg vorbis callbacks
     ov_callbacks callbacks;
@@ -157,10 +158,10 @@ namespace audiere {
   }
 
 
-  int
-  OGGInputStream::getLength() {
+  s64
+  OGGInputStream::getLength64() {
     if (isSeekable()) {
-      return static_cast<int>(ov_pcm_total(&m_vorbis_file, -1));
+      return ov_pcm_total(&m_vorbis_file, -1);
     } else {
       return 0;
     }
@@ -168,17 +169,17 @@ namespace audiere {
 
 
   void
-  OGGInputStream::setPosition(int position) {
+  OGGInputStream::setPosition64(s64 position) {
     if (isSeekable()) {
       ov_pcm_seek(&m_vorbis_file, position);
     }
   }
 
 
-  int
-  OGGInputStream::getPosition() {
+  s64
+  OGGInputStream::getPosition64() {
     if (isSeekable()) {
-      return static_cast<int>(ov_pcm_tell(&m_vorbis_file));
+      return ov_pcm_tell(&m_vorbis_file);
     } else {
       return 0;
     }
@@ -202,7 +203,7 @@ namespace audiere {
       case SEEK_END: type = File::END;     break;
       default: return -1;
     }
-    return (file->seek((int)offset, type) ? 0 : -1);
+    return (file->seek64(offset, type) ? 0 : -1);
   }
 
 
@@ -217,7 +218,7 @@ namespace audiere {
   long
   OGGInputStream::FileTell(void* opaque) {
     File* file = reinterpret_cast<File*>(opaque);
-    return file->tell();
+    return long(file->tell64());
   }
 
 }
@@ -24,9 +24,9 @@ namespace audiere {
     void ADR_CALL reset();
 
     bool ADR_CALL isSeekable();
-    int  ADR_CALL getLength();
-    void ADR_CALL setPosition(int position);
-    int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
 
   private:
     static size_t FileRead(void* buffer, size_t size, size_t n, void* opaque);
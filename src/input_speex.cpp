@@ -22,20 +22,16 @@ namespace audiere {
     }
 
     speexfile::offset_t seek(speexfile::offset_t offset) {
-      m_file->seek(static_cast<int>(offset), File::BEGIN);
+      m_file->seek64(offset, File::BEGIN);
       return get_position();
     }
 
     speexfile::offset_t get_position() {
-      return m_file->tell();
+      return m_file->tell64();
     }
 
     speexfile::offset_t get_length() {
-      speexfile::offset_t c = get_position();
-      m_file->seek(0, File::END);
-      speexfile::offset_t l = get_position();
-      m_file->seek(static_cast<int>(c), File::BEGIN);
-      return l;
+      return GetFileLength(m_file.get());
     }
 
     bool can_seek() {
@@ -44,7 +40,9 @@ namespace audiere {
   };
 
 
-  SpeexInputStream::SpeexInputStream() {
+  SpeexInputStream::SpeexInputStream()
+    : m_read_buffer(BUFFER_SIZE * sizeof(float))
+  {
     m_speexfile = 0;
     m_position = 0;
     m_decoder_text = "speex:standard";
@@ -59,6 +57,8 @@ namespace audiere {
   /// @todo  this really should be replaced with a factory function
   bool
   SpeexInputStream::initialize(FilePtr file) {
+    file->advise(File::ACCESS_SEQUENTIAL);
+
 #if defined(_MSC_VER) && (_MSC_VER <= 1200)
     m_reader = std::auto_ptr<speexfile::Reader>(new FileReader(file));
 #else
@@ -122,16 +122,17 @@ namespace audiere {
         m_read_buffer.write(decode_buffer, speex_read * sizeof(float));
       }
 
-      const int BUFFER_SIZE = 1024;
-      float read_buffer[BUFFER_SIZE];
-
-      int should_read = std::min(frame_count, BUFFER_SIZE);
-      int actual_read = m_read_buffer.read(read_buffer, should_read * sizeof(float)) / sizeof(float);
+      // convert straight out of the queue's storage
+      const void* span;
+      int available = m_read_buffer.peek(span) / sizeof(float);
+      int actual_read = std::min(frame_count, available);
       ADR_ASSERT(actual_read != 0, "Read queue should have data");
 
+      const float* in = (const float*)span;
       for (int i = 0; i < actual_read; ++i) {
-        out[i] = s16(read_buffer[i] * 32767);
+        out[i] = s16(in[i] * 32767);
       }
+      m_read_buffer.consume(actual_read * sizeof(float));
 
       frame_count -= actual_read;
       total_read += actual_read;
@@ -144,7 +145,7 @@ namespace audiere {
 
   void
   SpeexInputStream::reset() {
-    setPosition(0);  // need to update m_position
+    setPosition64(0);  // need to update m_position
   }
 
 
@@ -154,21 +155,21 @@ namespace audiere {
   }
 
 
-  int
-  SpeexInputStream::getLength() {
-    return static_cast<int>(m_speexfile->get_samples());
+  s64
+  SpeexInputStream::getLength64() {
+    return m_speexfile->get_samples();
   }
 
 
   void
-  SpeexInputStream::setPosition(int position) {
+  SpeexInputStream::setPosition64(s64 position) {
     m_speexfile->seek_sample(position);
     m_position = position;
   }
 
 
-  int
-  SpeexInputStream::getPosition() {
+  s64
+  SpeexInputStream::getPosition64() {
     return m_position;
   }
 
@@ -27,9 +27,9 @@ namespace audiere {
     void ADR_CALL reset();
 
     bool ADR_CALL isSeekable();
-    int  ADR_CALL getLength();
-    void ADR_CALL setPosition(int position);
-    int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
 
   private:
     bool findFormatChunk();
@@ -43,9 +43,9 @@ namespace audiere {
     std::auto_ptr<speexfile::Reader> m_reader;
 
     speexfile::speexfile* m_speexfile;
-    int m_position;  // Need to remember this because m_speexfile doesn't.
+    s64 m_position;  // Need to remember this because m_speexfile doesn't.
 
-    QueueBuffer m_read_buffer;
+    RingBuffer m_read_buffer;
   };
 
 }
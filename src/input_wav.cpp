@@ -6,6 +6,10 @@
 
 namespace audiere {
 
+  /// Largest format chunk read, enough for MS ADPCM's predictor table.
+  static const int MAX_FORMAT_CHUNK_SIZE = 256;
+
+
   static inline bool IsValidSampleSize(u32 size) {
     return (size == 8 || size == 16);
   }
@@ -17,6 +21,14 @@ namespace audiere {
     m_channel_count = 0;
     m_sample_rate   = 0;
     m_sample_format = SF_U8;  // reasonable default?
+    m_format_tag    = 1;
+
+    m_block_size       = 0;
+    m_frames_per_block = 0;
+    m_decoded_frames   = 0;
+    m_decoded_position = 0;
+
+    m_fact_length = -1;
 
     m_data_chunk_location = 0;
     m_data_chunk_length   = 0;
@@ -56,6 +68,7 @@ namespace audiere {
     }
 
     if (findFormatChunk() && findDataChunk()) {
+      m_file->advise(File::ACCESS_SEQUENTIAL);
       return true;
     } else {
       m_file = 0;
@@ -82,7 +95,28 @@ namespace audiere {
       return 0;
     }
 
-    const int frames_to_read = std::min(frame_count, m_frames_left_in_chunk);
+    const int frames_to_read = int(std::min(s64(frame_count), m_frames_left_in_chunk));
+
+    if (isAdpcm()) {
+      s16* out = (s16*)buffer;
+      int frames_read = 0;
+      while (frames_read < frames_to_read) {
+        if (m_decoded_position == m_decoded_frames && !decodeBlock()) {
+          m_frames_left_in_chunk = 0;
+          return frames_read;
+        }
+        const int count = std::min(frames_to_read - frames_read,
+                                   m_decoded_frames - m_decoded_position);
+        memcpy(out + frames_read * m_channel_count,
+               &m_decoded[m_decoded_position * m_channel_count],
+               count * m_channel_count * sizeof(s16));
+        frames_read        += count;
+        m_decoded_position += count;
+      }
+      m_frames_left_in_chunk -= frames_read;
+      return frames_read;
+    }
+
     const int frame_size = m_channel_count * GetSampleSize(m_sample_format);
     const int bytes_to_read = frames_to_read * frame_size;
 
@@ -115,7 +149,9 @@ namespace audiere {
   WAVInputStream::reset() {
     // seek to the beginning of the data chunk
     m_frames_left_in_chunk = m_data_chunk_length;
-    m_file->seek(m_data_chunk_location, File::BEGIN);
+    m_file->seek64(m_data_chunk_location, File::BEGIN);
+    m_decoded_frames   = 0;
+    m_decoded_position = 0;
   }
 
 
@@ -125,26 +161,101 @@ namespace audiere {
   }
 
 
-  int
-  WAVInputStream::getLength() {
+  s64
+  WAVInputStream::getLength64() {
     return m_data_chunk_length;
   }
 
 
   void
-  WAVInputStream::setPosition(int position) {
+  WAVInputStream::setPosition64(s64 position) {
+    if (isAdpcm()) {
+      // decode the block containing position and skip into it
+      const s64 block = position / m_frames_per_block;
+      m_frames_left_in_chunk = m_data_chunk_length - position;
+      m_file->seek64(m_data_chunk_location + block * m_block_size,
+                     File::BEGIN);
+      m_decoded_frames   = 0;
+      m_decoded_position = 0;
+
+      const int skip = int(position % m_frames_per_block);
+      if (skip && decodeBlock()) {
+        m_decoded_position = std::min(skip, m_decoded_frames);
+      }
+      return;
+    }
+
     int frame_size = m_channel_count * GetSampleSize(m_sample_format);
     m_frames_left_in_chunk = m_data_chunk_length - position;
-    m_file->seek(m_data_chunk_location + position * frame_size, File::BEGIN);
+    m_file->seek64(m_data_chunk_location + position * frame_size, File::BEGIN);
   }
 
 
-  int
-  WAVInputStream::getPosition() {
+  s64
+  WAVInputStream::getPosition64() {
     return m_data_chunk_length - m_frames_left_in_chunk;
   }
 
 
+  int
+  WAVInputStream::acquireBlock(int frame_count, const void*& block) {
+    block = 0;
+
+    // ADPCM is lent straight out of the decoded block
+    if (isAdpcm()) {
+      if (m_frames_left_in_chunk == 0) {
+        return 0;
+      }
+      if (m_decoded_position == m_decoded_frames && !decodeBlock()) {
+        m_frames_left_in_chunk = 0;
+        return 0;
+      }
+      block = &m_decoded[m_decoded_position * m_channel_count];
+      s64 frames = std::min(s64(frame_count), m_frames_left_in_chunk);
+      return int(std::min(frames, s64(m_decoded_frames - m_decoded_position)));
+    }
+
+#if WORDS_BIGENDIAN
+    // 16-bit samples have to be byte-swapped by doRead()
+    if (m_sample_format == SF_S16) {
+      return 0;
+    }
+#endif
+
+    // only possible when the file lives in memory, e.g. when it's mapped
+    const void* data;
+    s64 size = m_file->getData(data);
+    if (!data || m_frames_left_in_chunk == 0) {
+      return 0;
+    }
+
+    const int frame_size = m_channel_count * GetSampleSize(m_sample_format);
+    const s64 position = m_file->tell64();
+    s64 frames = std::min(s64(frame_count), m_frames_left_in_chunk);
+    frames = std::min(frames, (size - position) / frame_size);
+    if (frames <= 0) {
+      return 0;
+    }
+
+    block = (const u8*)data + position;
+    return int(frames);
+  }
+
+
+  void
+  WAVInputStream::releaseBlock(int frame_count) {
+    if (isAdpcm()) {
+      m_decoded_position     += frame_count;
+      m_frames_left_in_chunk -= frame_count;
+      return;
+    }
+
+    const int frame_size = m_channel_count * GetSampleSize(m_sample_format);
+    m_file->seek(frame_count * frame_size, File::CURRENT);
+    m_frames_left_in_chunk -= frame_count;
+  }
+
+
   bool
   WAVInputStream::findFormatChunk() {
     ADR_GUARD("WAVInputStream::findFormatChunk");
@@ -171,12 +282,14 @@ namespace audiere {
 
         ADR_LOG("Found format chunk");
 
-        // read format chunk
-        u8 chunk[16];
-        size = m_file->read(chunk, 16);
+        // read format chunk, along with the extension compressed
+        // formats keep after the first 16 bytes
+        u8 chunk[MAX_FORMAT_CHUNK_SIZE];
+        const int chunk_size = int(std::min(chunk_length, u32(MAX_FORMAT_CHUNK_SIZE)));
+        size = m_file->read(chunk, chunk_size);
 
         // could we read the entire format chunk?
-        if (size < 16) {
+        if (size < chunk_size) {
           return false;
         }
 
@@ -187,14 +300,39 @@ namespace audiere {
         u16 channel_count      = read16_le(chunk + 2);
         u32 samples_per_second = read32_le(chunk + 4);
         //u32 bytes_per_second   = read32_le(chunk + 8);
-        //u16 block_align        = read16_le(chunk + 12);
+        u16 block_align        = read16_le(chunk + 12);
         u16 bits_per_sample    = read16_le(chunk + 14);
 
-        // format_tag must be 1 (WAVE_FORMAT_PCM)
         // we only support mono and stereo
-        if (format_tag != 1 ||
-            channel_count > 2 ||
-            !IsValidSampleSize(bits_per_sample)) {
+        if (channel_count == 0 || channel_count > 2) {
+          ADR_LOG("Invalid WAV");
+          return false;
+        }
+
+        // store the other important .wav attributes
+        m_channel_count = channel_count;
+        m_sample_rate   = samples_per_second;
+        m_format_tag    = format_tag;
+
+        if (format_tag == WAVE_FORMAT_ADPCM ||
+            format_tag == WAVE_FORMAT_IMA_ADPCM)
+        {
+          // the extension starts with its own size
+          const int extension_size = (size >= 18 ? std::min(
+            int(read16_le(chunk + 16)), size - 18) : 0);
+          if (!initAdpcm(format_tag, block_align, bits_per_sample,
+                         chunk + 18, extension_size) ||
+              !skipBytes(chunk_length))
+          {
+            ADR_LOG("Invalid ADPCM WAV");
+            return false;
+          }
+          m_sample_format = SF_S16;
+          return true;
+        }
+
+        // otherwise, format_tag must be 1 (WAVE_FORMAT_PCM)
+        if (format_tag != 1 || !IsValidSampleSize(bits_per_sample)) {
           ADR_LOG("Invalid WAV");
           return false;
         }
@@ -213,10 +351,6 @@ namespace audiere {
         } else {
           return false;
         }
-
-        // store the other important .wav attributes
-        m_channel_count = channel_count;
-        m_sample_rate   = samples_per_second;
         return true;
 
       } else {
@@ -259,14 +393,41 @@ namespace audiere {
 
         ADR_LOG("Found data chunk");
 
-        // calculate the frame size so we can truncate the data chunk
-        int frame_size = m_channel_count * GetSampleSize(m_sample_format);
+        m_data_chunk_location = m_file->tell64();
+
+        if (isAdpcm()) {
+          // whole blocks, then whatever fits in a truncated last block
+          const int last_block_size = chunk_length % m_block_size;
+          int last_block_frames = (m_format_tag == WAVE_FORMAT_ADPCM ?
+            GetMsFramesPerBlock (last_block_size, m_channel_count) :
+            GetImaFramesPerBlock(last_block_size, m_channel_count));
+          last_block_frames = std::min(last_block_frames, m_frames_per_block);
+
+          m_data_chunk_length =
+            s64(chunk_length / m_block_size) * m_frames_per_block +
+            last_block_frames;
+
+          // the fact chunk tells how much of the last block is padding
+          if (m_fact_length >= 0) {
+            m_data_chunk_length = std::min(m_data_chunk_length, m_fact_length);
+          }
+        } else {
+          // calculate the frame size so we can truncate the data chunk
+          int frame_size = m_channel_count * GetSampleSize(m_sample_format);
+          m_data_chunk_length = chunk_length / frame_size;
+        }
 
-        m_data_chunk_location  = m_file->tell();
-        m_data_chunk_length    = chunk_length / frame_size;
         m_frames_left_in_chunk = m_data_chunk_length;
         return true;
 
+      } else if (memcmp(chunk_id, "fact", 4) == 0 && chunk_length >= 4) {
+
+        u8 fact[4];
+        if (m_file->read(fact, 4) != 4 || !skipBytes(chunk_length - 4)) {
+          return false;
+        }
+        m_fact_length = read32_le(fact);
+
       } else {
 
         ADR_IF_DEBUG {
@@ -289,8 +450,89 @@ namespace audiere {
 
 
   bool
-  WAVInputStream::skipBytes(int size) {
-    return m_file->seek(size, File::CURRENT);
+  WAVInputStream::initAdpcm(
+    int format_tag, int block_align, int bits_per_sample,
+    const u8* extension, int extension_size)
+  {
+    if (bits_per_sample != 4 || block_align == 0) {
+      return false;
+    }
+
+    m_block_size = block_align;
+    if (format_tag == WAVE_FORMAT_ADPCM) {
+      m_frames_per_block = GetMsFramesPerBlock(block_align, m_channel_count);
+
+      // the file's predictors follow the frames per block, if it has any
+      int count = (extension_size >= 4 ? read16_le(extension + 2) : 0);
+      count = std::min(count, (extension_size - 4) / 4);
+      if (count > 0) {
+        m_coefficients.resize(count);
+        for (int i = 0; i < count; ++i) {
+          m_coefficients[i].coef1 = s16(read16_le(extension + 4 + i * 4));
+          m_coefficients[i].coef2 = s16(read16_le(extension + 6 + i * 4));
+        }
+      } else {
+        m_coefficients.assign(
+          MS_ADPCM_COEFFICIENTS,
+          MS_ADPCM_COEFFICIENTS + sizeof(MS_ADPCM_COEFFICIENTS) /
+                                  sizeof(*MS_ADPCM_COEFFICIENTS));
+      }
+    } else {
+      m_frames_per_block = GetImaFramesPerBlock(block_align, m_channel_count);
+    }
+
+    // an encoder may use fewer frames than fit in a block
+    if (extension_size >= 2) {
+      const int frames = read16_le(extension);
+      if (frames > 0 && frames < m_frames_per_block) {
+        m_frames_per_block = frames;
+      }
+    }
+
+    if (m_frames_per_block <= 0) {
+      return false;
+    }
+
+    m_block.resize(m_block_size);
+    m_decoded.resize(m_frames_per_block * m_channel_count);
+    return true;
+  }
+
+
+  bool
+  WAVInputStream::decodeBlock() {
+    m_decoded_frames   = 0;
+    m_decoded_position = 0;
+
+    const int read = m_file->read(&m_block[0], m_block_size);
+
+    // the last block may be cut short
+    int frames;
+    bool decoded;
+    if (m_format_tag == WAVE_FORMAT_ADPCM) {
+      frames = std::min(m_frames_per_block,
+                        GetMsFramesPerBlock(read, m_channel_count));
+      decoded = DecodeMsBlock(
+        &m_block[0], m_channel_count, frames, &m_decoded[0],
+        &m_coefficients[0], int(m_coefficients.size()));
+    } else {
+      frames = std::min(m_frames_per_block,
+                        GetImaFramesPerBlock(read, m_channel_count));
+      decoded = DecodeImaBlock(
+        &m_block[0], m_channel_count, frames, &m_decoded[0]);
+    }
+
+    if (!decoded || frames <= 0) {
+      return false;
+    }
+    m_decoded_frames = frames;
+    return true;
+  }
+
+
+  bool
+  WAVInputStream::skipBytes(s64 size) {
+    return m_file->seek64(size, File::CURRENT);
   }
 
 
@@ -2,6 +2,8 @@
 #define INPUT_WAV_H
 
 
+#include <vector>
+#include "adpcm.h"
 #include "audiere.h"
 #include "basic_source.h"
 #include "types.h"
@@ -23,14 +25,26 @@ namespace audiere {
     void ADR_CALL reset();
 
     bool ADR_CALL isSeekable();
-    int  ADR_CALL getLength();
-    void ADR_CALL setPosition(int position);
-    int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
+
+    int  ADR_CALL acquireBlock(int frame_count, const void*& block);
+    void ADR_CALL releaseBlock(int frame_count);
 
   private:
     bool findFormatChunk();
+    bool initAdpcm(int format_tag, int block_align, int bits_per_sample,
+                   const u8* extension, int extension_size);
     bool findDataChunk();
-    bool skipBytes(int size);
+    bool skipBytes(s64 size);
+
+    bool isAdpcm() const {
+      return m_format_tag != 1;
+    }
+
+    /// Reads and decodes the next ADPCM block into m_decoded.
+    bool decodeBlock();
 
   private:
     FilePtr m_file;
@@ -39,12 +53,25 @@ namespace audiere {
     int m_channel_count;
     int m_sample_rate;
     SampleFormat m_sample_format;
+    int m_format_tag;
+
+    // ADPCM only
+    int m_block_size;        // bytes
+    int m_frames_per_block;
+    std::vector<AdpcmCoefficients> m_coefficients;  // MS ADPCM
+    std::vector<u8>  m_block;
+    std::vector<s16> m_decoded;
+    int m_decoded_frames;
+    int m_decoded_position;
+
+    // from fact chunk, or -1
+    s64 m_fact_length;
 
     // from data chunk
-    int m_data_chunk_location; // bytes
-    int m_data_chunk_length;   // in frames
+    s64 m_data_chunk_location; // bytes
+    s64 m_data_chunk_length;   // in frames
 
-    int m_frames_left_in_chunk;
+    s64 m_frames_left_in_chunk;
   };
 
 }
@@ -0,0 +1,78 @@
+#include <algorithm>
+#include "debug.h"
+#include "io_scheduler.h"
+
+
+namespace audiere {
+
+  static Mutex s_scheduler_mutex;
+  static IOScheduler* s_scheduler = 0;
+
+
+  static bool RequestLess(const IORequestPtr& a, const IORequestPtr& b) {
+    if (a->getFile() != b->getFile()) {
+      return (a->getFile() < b->getFile());
+    }
+    return (a->getOffset() < b->getOffset());
+  }
+
+
+  IOScheduler& IOScheduler::get() {
+    SYNCHRONIZED(s_scheduler_mutex);
+    if (!s_scheduler) {
+      s_scheduler = new IOScheduler();
+    }
+    return *s_scheduler;
+  }
+
+
+  IOScheduler::IOScheduler() {
+    ADR_GUARD("IOScheduler::IOScheduler");
+    m_has_thread = AI_CreateThread(threadRoutine, this);
+    if (!m_has_thread) {
+      ADR_LOG("THREAD CREATION FAILED");
+    }
+  }
+
+
+  void IOScheduler::submit(IORequest* request) {
+    if (!m_has_thread) {
+      // nothing would ever take the request off the queue
+      IORequestPtr inline_request = request;
+      inline_request->run();
+      return;
+    }
+
+    m_mutex.lock();
+    m_requests.push_back(request);
+    m_mutex.unlock();
+    m_requests_available.notify();
+  }
+
+
+  void IOScheduler::threadRoutine(void* arg) {
+    ADR_GUARD("IOScheduler::threadRoutine");
+    IOScheduler* This = static_cast<IOScheduler*>(arg);
+    This->run();
+  }
+
+
+  void IOScheduler::run() {
+    std::vector<IORequestPtr> batch;
+    for (;;) {
+      m_mutex.lock();
+      while (m_requests.empty()) {
+        m_requests_available.wait(m_mutex);
+      }
+      batch.swap(m_requests);
+      m_mutex.unlock();
+
+      std::stable_sort(batch.begin(), batch.end(), RequestLess);
+      for (size_t i = 0; i < batch.size(); ++i) {
+        batch[i]->run();
+      }
+      batch.clear();
+    }
+  }
+
+}
@@ -0,0 +1,66 @@
+/**
+ * @file
+ *
+ * Library-wide scheduler for background file reads
+ */
+
+#ifndef IO_SCHEDULER_H
+#define IO_SCHEDULER_H
+
+
+#include <vector>
+#include "audiere.h"
+#include "threads.h"
+
+
+namespace audiere {
+
+  /// A single read to be performed on the scheduler's thread.
+  class IORequest : public RefImplementation<RefCounted> {
+  public:
+    /// The file the request reads from, used to group requests.
+    virtual File* getFile() = 0;
+
+    /// Where in the file the read starts, used to order requests.
+    virtual s64 getOffset() = 0;
+
+    virtual void run() = 0;
+  };
+  typedef RefPtr<IORequest> IORequestPtr;
+
+
+  /**
+   * Performs queued reads on a dedicated thread so that decoders don't
+   * block on the device.  Whatever has been queued when the thread wakes
+   * up is serviced as one batch, sorted by file and offset so that reads
+   * from the same file happen in order.
+   *
+   * The scheduler is created on first use and lives for the rest of the
+   * process.  It does not share threads with the WorkerPool, so that long
+   * load jobs can't hold up read-ahead for playing streams.  If its
+   * thread couldn't be started, requests run inside submit().
+   */
+  class IOScheduler {
+  public:
+    /// Returns the scheduler shared by the whole library.
+    static IOScheduler& get();
+
+    void submit(IORequest* request);
+
+  private:
+    IOScheduler();
+
+    static void threadRoutine(void* arg);
+    void run();
+
+    bool m_has_thread;
+
+    Mutex m_mutex;
+    CondVar m_requests_available;
+    std::vector<IORequestPtr> m_requests;
+  };
+
+}
+
+
+#endif
@@ -0,0 +1,377 @@
+/**
+ * @file
+ *
+ * Asynchronous loading of sample sources, sample buffers, and sounds on
+ * the library's worker pool.
+ */
+
+#include <algorithm>
+#include <string>
+#include "debug.h"
+#include "internal.h"
+#include "threads.h"
+#include "timer.h"
+#include "utility.h"
+#include "worker_pool.h"
+
+
+namespace audiere {
+
+  class LoadRequestImpl;
+
+
+  class LoadEventImpl : public RefImplementation<LoadEvent> {
+  public:
+    LoadEventImpl(LoadRequest* request) {
+      m_request = request;
+    }
+
+    LoadRequest* ADR_CALL getRequest() {
+      return m_request.get();
+    }
+
+  private:
+    LoadRequestPtr m_request;
+  };
+
+
+  class LoadJob : public WorkerJob {
+  public:
+    LoadJob(LoadRequestImpl* request);
+    void run();
+
+  private:
+    RefPtr<LoadRequestImpl> m_request;
+  };
+
+
+  class LoadRequestImpl : public RefImplementation<LoadRequest> {
+  public:
+    enum Kind {
+      LOAD_SOURCE,
+      LOAD_BUFFER,
+      LOAD_SOUND,
+    };
+
+    LoadRequestImpl(
+      Kind kind,
+      const char* filename,
+      File* file,
+      FileFormat file_format,
+      AudioDevice* device,
+      bool streaming,
+      Callback* callback)
+    {
+      m_kind        = kind;
+      m_name        = (filename ? filename : "");
+      m_file        = file;
+      m_file_format = file_format;
+      m_device      = device;
+      m_streaming   = streaming;
+      m_callback    = callback;
+
+      m_state     = QUEUED;
+      m_cancelled = false;
+      m_load_time = 0;
+
+      m_job = new LoadJob(this);
+    }
+
+    WorkerJob* getJob() {
+      return m_job.get();
+    }
+
+    const char* ADR_CALL getName() {
+      return m_name.c_str();
+    }
+
+    bool ADR_CALL isDone() {
+      SYNCHRONIZED(m_mutex);
+      return (m_state == DONE);
+    }
+
+    bool ADR_CALL wait(int milliseconds) {
+      u64 deadline = GetNow() + u64(milliseconds < 0 ? 0 : milliseconds) * 1000;
+
+      m_mutex.lock();
+      while (m_state != DONE) {
+        float timeout = 1;
+        if (milliseconds >= 0) {
+          u64 now = GetNow();
+          if (now >= deadline) {
+            break;
+          }
+          timeout = std::min(timeout, (deadline - now) / 1000000.0f);
+        }
+        m_done.wait(m_mutex, timeout);
+      }
+      bool done = (m_state == DONE);
+      m_mutex.unlock();
+
+      // pass the wakeup on to anyone else waiting
+      if (done) {
+        m_done.notify();
+      }
+      return done;
+    }
+
+    bool ADR_CALL cancel() {
+      WorkerJobPtr job;
+      {
+        SYNCHRONIZED(m_mutex);
+        if (m_state == DONE) {
+          return m_cancelled;
+        }
+        m_cancelled = true;
+        if (m_state == RUNNING) {
+          // execute() throws the result away
+          return true;
+        }
+        job = m_job;
+      }
+
+      // If the job was already taken off the queue, execute() will see the
+      // cancellation before it starts loading.
+      if (WorkerPool::get().remove(job.get())) {
+        complete();
+      }
+      return true;
+    }
+
+    bool ADR_CALL isCancelled() {
+      SYNCHRONIZED(m_mutex);
+      return m_cancelled;
+    }
+
+    int ADR_CALL getLoadTime() {
+      SYNCHRONIZED(m_mutex);
+      return m_load_time;
+    }
+
+    SampleSource* ADR_CALL getSampleSource() {
+      SYNCHRONIZED(m_mutex);
+      return (m_state == DONE ? m_source.get() : 0);
+    }
+
+    SampleBuffer* ADR_CALL getSampleBuffer() {
+      SYNCHRONIZED(m_mutex);
+      return (m_state == DONE ? m_buffer.get() : 0);
+    }
+
+    OutputStream* ADR_CALL getOutputStream() {
+      SYNCHRONIZED(m_mutex);
+      return (m_state == DONE ? m_stream.get() : 0);
+    }
+
+    /// Called on a worker thread.
+    void execute() {
+      ADR_GUARD("LoadRequestImpl::execute");
+
+      bool cancelled;
+      {
+        SYNCHRONIZED(m_mutex);
+        cancelled = m_cancelled;
+        if (!cancelled) {
+          m_state = RUNNING;
+        }
+      }
+      if (cancelled) {
+        complete();
+        return;
+      }
+
+      // Declared outside the lock below so that a result which is thrown
+      // away is destroyed without holding it.
+      SampleSourcePtr source;
+      SampleBufferPtr buffer;
+      OutputStreamPtr stream;
+
+      u64 start = GetNow();
+      if (m_file) {
+        source = hidden::AdrOpenSampleSourceFromFile(m_file.get(), m_file_format);
+      } else {
+        source = hidden::AdrOpenSampleSource(m_name.c_str(), m_file_format);
+      }
+
+      if (source) {
+        if (m_kind == LOAD_BUFFER) {
+          buffer = hidden::AdrCreateSampleBufferFromSource(source.get());
+          source = 0;
+        } else if (m_kind == LOAD_SOUND) {
+          stream = hidden::AdrOpenSound(m_device.get(), source.get(), m_streaming);
+          source = 0;
+
+          // decode the first block here rather than on the audio thread
+          if (stream) {
+            stream->prime();
+          }
+        }
+      }
+      u64 elapsed = GetNow() - start;
+
+      bool notify;
+      {
+        SYNCHRONIZED(m_mutex);
+        m_load_time = int(elapsed / 1000);
+        if (!m_cancelled) {
+          m_source = source;
+          m_buffer = buffer;
+          m_stream = stream;
+        }
+        notify = (!m_cancelled && m_callback);
+      }
+      complete();
+
+      if (notify && m_callback->getType() == ET_LOAD) {
+        LoadEventPtr event = new LoadEventImpl(this);
+        m_callback->call(event.get());
+      }
+    }
+
+  private:
+    /// Marks the request done and lets go of everything the load needed.
+    void complete() {
+      WorkerJobPtr job;
+      FilePtr file;
+      AudioDevicePtr device;
+      {
+        SYNCHRONIZED(m_mutex);
+        m_state = DONE;
+        job = m_job;
+        m_job = 0;
+        file = m_file;
+        m_file = 0;
+        device = m_device;
+        m_device = 0;
+      }
+      m_done.notify();
+    }
+
+    enum State {
+      QUEUED,
+      RUNNING,
+      DONE,
+    };
+
+    Kind m_kind;
+    std::string m_name;
+    FilePtr m_file;
+    FileFormat m_file_format;
+    AudioDevicePtr m_device;
+    bool m_streaming;
+    CallbackPtr m_callback;
+
+    Mutex m_mutex;
+    CondVar m_done;
+    State m_state;
+    bool m_cancelled;
+    int m_load_time;
+    WorkerJobPtr m_job;
+
+    SampleSourcePtr m_source;
+    SampleBufferPtr m_buffer;
+    OutputStreamPtr m_stream;
+  };
+
+
+  LoadJob::LoadJob(LoadRequestImpl* request) {
+    m_request = request;
+  }
+
+  void LoadJob::run() {
+    m_request->execute();
+  }
+
+
+  /// Queues the request and returns it with a reference for the caller.
+  static LoadRequest* Submit(LoadRequestImpl* request) {
+    request->ref();
+    WorkerPool::get().submit(request->getJob());
+    return request;
+  }
+
+
+  ADR_EXPORT(LoadRequest*) AdrOpenSampleSourceAsync(
+    const char* filename,
+    FileFormat file_format,
+    Callback* callback)
+  {
+    if (!filename) {
+      return 0;
+    }
+    return Submit(new LoadRequestImpl(
+      LoadRequestImpl::LOAD_SOURCE, filename, 0, file_format,
+      0, false, callback));
+  }
+
+
+  ADR_EXPORT(LoadRequest*) AdrOpenSampleSourceFromFileAsync(
+    File* file,
+    FileFormat file_format,
+    Callback* callback)
+  {
+    if (!file) {
+      return 0;
+    }
+    return Submit(new LoadRequestImpl(
+      LoadRequestImpl::LOAD_SOURCE, 0, file, file_format,
+      0, false, callback));
+  }
+
+
+  ADR_EXPORT(LoadRequest*) AdrCreateSampleBufferAsync(
+    const char* filename,
+    FileFormat file_format,
+    Callback* callback)
+  {
+    if (!filename) {
+      return 0;
+    }
+    return Submit(new LoadRequestImpl(
+      LoadRequestImpl::LOAD_BUFFER, filename, 0, file_format,
+      0, false, callback));
+  }
+
+
+  ADR_EXPORT(void) AdrCreateSampleBuffersAsync(
+    const char** filenames,
+    int count,
+    FileFormat file_format,
+    Callback* callback,
+    LoadRequest** requests)
+  {
+    std::vector<WorkerJob*> jobs;
+    for (int i = 0; i < count; ++i) {
+      requests[i] = 0;
+      if (filenames[i]) {
+        LoadRequestImpl* request = new LoadRequestImpl(
+          LoadRequestImpl::LOAD_BUFFER, filenames[i], 0, file_format,
+          0, false, callback);
+        request->ref();
+        requests[i] = request;
+        jobs.push_back(request->getJob());
+      }
+    }
+
+    if (!jobs.empty()) {
+      WorkerPool::get().submit(&jobs[0], int(jobs.size()));
+    }
+  }
+
+
+  ADR_EXPORT(LoadRequest*) AdrOpenSoundAsync(
+    AudioDevice* device,
+    const char* filename,
+    bool streaming,
+    FileFormat file_format,
+    Callback* callback)
+  {
+    if (!device || !filename) {
+      return 0;
+    }
+    return Submit(new LoadRequestImpl(
+      LoadRequestImpl::LOAD_SOUND, filename, 0, file_format,
+      device, streaming, callback));
+  }
+
+}
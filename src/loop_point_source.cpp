@@ -114,30 +114,81 @@ namespace audiere {
           return frames_read;
         }
 
-        if (position + read == next_point) {
-          if (next_point_idx == -1) {
-            m_source->setPosition(0);
-          } else {
-            LoopPoint& lp = m_loop_points[next_point_idx];
-
-            bool doloop = (lp.originalLoopCount <= 0 || lp.loopCount > 0);
-            if (doloop && lp.originalLoopCount > 0) {
-              --lp.loopCount;
-            }
-
-            if (doloop) {
-              if (lp.target == lp.location) {
-                return frames_read;
-              }
-              m_source->setPosition(lp.target);
-            }
-          }
+        if (position + read == next_point && !followLoopPoint(next_point_idx)) {
+          return frames_read;
         }
       }
 
       return frames_read;
     }
 
+
+    int ADR_CALL acquireBlock(int frame_count, const void*& block) {
+      // never lend out frames past the next loop point
+      if (m_source->getRepeat()) {
+        int position = m_source->getPosition();
+        int next_point_idx = getNextLoopPoint(position);
+        int next_point = (next_point_idx == -1
+                            ? m_length
+                            : m_loop_points[next_point_idx].location);
+        frame_count = std::min(frame_count, next_point - position);
+        if (frame_count <= 0) {
+          block = 0;
+          return 0;
+        }
+      }
+
+      return m_source->acquireBlock(frame_count, block);
+    }
+
+
+    void ADR_CALL releaseBlock(int frame_count) {
+      if (!m_source->getRepeat()) {
+        m_source->releaseBlock(frame_count);
+        return;
+      }
+
+      int position = m_source->getPosition();
+      int next_point_idx = getNextLoopPoint(position);
+      int next_point = (next_point_idx == -1
+                          ? m_length
+                          : m_loop_points[next_point_idx].location);
+
+      m_source->releaseBlock(frame_count);
+      if (position + frame_count == next_point) {
+        followLoopPoint(next_point_idx);
+      }
+    }
+
+
+    /**
+     * Jumps to the target of the loop point with index idx (or to the
+     * beginning, if idx is -1) once the source has reached it.  Returns
+     * false if the loop point targets itself, in which case reading
+     * should stop.
+     */
+    bool followLoopPoint(int idx) {
+      if (idx == -1) {
+        m_source->setPosition(0);
+        return true;
+      }
+
+      LoopPoint& lp = m_loop_points[idx];
+
+      bool doloop = (lp.originalLoopCount <= 0 || lp.loopCount > 0);
+      if (doloop && lp.originalLoopCount > 0) {
+        --lp.loopCount;
+      }
+
+      if (doloop) {
+        if (lp.target == lp.location) {
+          return false;
+        }
+        m_source->setPosition(lp.target);
+      }
+      return true;
+    }
+
     int getNextLoopPoint(int position) {
       for (size_t i = 0; i < m_loop_points.size(); ++i) {
         if (position < m_loop_points[i].location) {
@@ -174,6 +225,18 @@ namespace audiere {
       return m_source->getPosition();
     }
 
+    s64 ADR_CALL getLength64() {
+      return m_source->getLength64();
+    }
+
+    void ADR_CALL setPosition64(s64 position) {
+      m_source->setPosition64(position);
+    }
+
+    s64 ADR_CALL getPosition64() {
+      return m_source->getPosition64();
+    }
+
     bool ADR_CALL getRepeat() {
       return m_source->getRepeat();
     }
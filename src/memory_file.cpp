@@ -17,19 +17,38 @@ namespace audiere {
   }
 
 
-  int getNextPowerOfTwo(int value) {
-    int i = 1;
-    while (i < value) {
-      i *= 2;
+  ADR_EXPORT(File*) AdrCreateBorrowedMemoryFile(
+    const void* buffer,
+    int size,
+    RefCounted* owner)
+  {
+    if (size && !buffer) {
+      return 0;
+    }
+    if (size < 0) {
+      return 0;
     }
-    return i;
+
+    return new MemoryFile(buffer, size, owner);
   }
 
+
   MemoryFile::MemoryFile(const void* buffer, int size) {
     m_capacity = getNextPowerOfTwo(size);
     m_size = size;
     m_buffer = new u8[m_capacity];
     memcpy(m_buffer, buffer, size);
+    m_data = m_buffer;
+
+    m_position = 0;
+  }
+
+  MemoryFile::MemoryFile(const void* buffer, int size, RefCounted* owner) {
+    m_capacity = 0;
+    m_size = size;
+    m_buffer = 0;
+    m_data = (const u8*)buffer;
+    m_owner = owner;
 
     m_position = 0;
   }
@@ -40,7 +59,7 @@ namespace audiere {
 
   int ADR_CALL MemoryFile::read(void* buffer, int size) {
     int real_read = std::min((m_size - m_position), size);
-    memcpy(buffer, m_buffer + m_position, real_read);
+    memcpy(buffer, m_data + m_position, real_read);
     m_position += real_read;
     return real_read;
   }
@@ -74,7 +93,21 @@ namespace audiere {
     return m_position;
   }
 
+  s64 ADR_CALL MemoryFile::getData(const void*& data) {
+    data = m_data;
+    return m_size;
+  }
+
   void MemoryFile::ensureSize(int min_size) {
+    // copy on write: take our own copy of a borrowed buffer
+    if (!m_buffer) {
+      m_capacity = getNextPowerOfTwo(std::max(m_size, min_size));
+      m_buffer = new u8[m_capacity];
+      memcpy(m_buffer, m_data, m_size);
+      m_data = m_buffer;
+      m_owner = 0;
+    }
+
     bool realloc_needed = false;
     while (m_capacity < min_size) {
       m_capacity *= 2;
@@ -86,9 +119,10 @@ namespace audiere {
       memcpy(new_buffer, m_buffer, m_size);
       delete[] m_buffer;
       m_buffer = new_buffer;
+      m_data = m_buffer;
     }
 
-    m_size = min_size;
+    m_size = std::max(m_size, min_size);
   }
 
 };
@@ -10,18 +10,35 @@ namespace audiere {
 
   class MemoryFile : public RefImplementation<File> {
   public:
+    /// Makes a private copy of the buffer.
     MemoryFile(const void* buffer, int size);
+
+    /**
+     * Reads straight from the caller's buffer without copying it.  If
+     * owner is not 0, the file holds a reference to it for as long as
+     * the buffer is in use.  The buffer is only copied if write() is
+     * called.
+     */
+    MemoryFile(const void* buffer, int size, RefCounted* owner);
+
     ~MemoryFile();
 
     int  ADR_CALL read(void* buffer, int size);
     int  ADR_CALL write(const void* buffer, int size);
     bool ADR_CALL seek(int position, SeekMode mode);
     int  ADR_CALL tell();
+    s64  ADR_CALL getData(const void*& data);
 
   private:
     void ensureSize(int min_size);
 
+    /// Contents of the file.  Either m_buffer or the borrowed buffer.
+    const u8* m_data;
+
+    /// Our own copy of the contents, or 0 while borrowing.
     u8* m_buffer;
+    RefPtr<RefCounted> m_owner;
+
     int m_position;
     int m_size;
 
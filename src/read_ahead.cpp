@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <string.h>
+#include "read_ahead.h"
+
+
+namespace audiere {
+
+  ReadAheadBuffer::ReadAheadBuffer() {
+    m_length        = 0;
+    m_buffer_length = 1;
+    m_unit_size     = 1;
+    m_alignment     = 1;
+
+    for (int i = 0; i < BUFFER_COUNT; ++i) {
+      m_buffers[i].start  = 0;
+      m_buffers[i].length = 0;
+      m_buffers[i].state  = EMPTY;
+    }
+  }
+
+
+  ReadAheadBuffer::~ReadAheadBuffer() {
+    // queued fills hold a reference to the subclass, so none are in
+    // flight here
+  }
+
+
+  void ReadAheadBuffer::initBuffers(
+    s64 length,
+    int buffer_length,
+    int unit_size,
+    int alignment)
+  {
+    m_length        = length;
+    m_buffer_length = std::max(1, buffer_length);
+    m_unit_size     = unit_size;
+    m_alignment     = std::max(1, alignment);
+
+    for (int i = 0; i < BUFFER_COUNT; ++i) {
+      m_buffers[i].data.resize(m_buffer_length * m_unit_size);
+    }
+  }
+
+
+  int ReadAheadBuffer::readBuffered(
+    s64& position,
+    int count,
+    void* out,
+    bool read_ahead)
+  {
+    u8* dest = (u8*)out;
+    int total = 0;
+
+    m_mutex.lock();
+    while (total < count && position < m_length) {
+      int i = findBuffer(position);
+      if (i < 0) {
+        // Nothing covers the position, e.g. after a seek.  This read has
+        // to wait for the fill anyway, so do it here rather than queueing
+        // it behind others.
+        i = findFreeBuffer();
+        if (i < 0) {
+          m_buffer_ready.wait(m_mutex, 1);
+          continue;
+        }
+        Buffer& buffer = m_buffers[i];
+        const s64 start = position - position % m_alignment;
+        buffer.start = start;
+        buffer.state = PENDING;
+        m_mutex.unlock();
+        const int length = fillBuffer(start, &buffer.data[0]);
+        m_mutex.lock();
+        buffer.length = length;
+        buffer.state  = READY;
+        if (length == 0) {
+          break;
+        }
+        continue;
+      }
+
+      Buffer& buffer = m_buffers[i];
+      if (buffer.state == PENDING) {
+        // If the fill hasn't started, e.g. because its thread is busy
+        // with something long, take it back and fill it here instead.
+        if (buffer.job && cancelJob(buffer.job.get())) {
+          buffer.job   = 0;
+          buffer.state = EMPTY;
+        } else {
+          m_buffer_ready.wait(m_mutex, 1);
+        }
+        continue;
+      }
+
+      const s64 available = buffer.start + buffer.length - position;
+      if (available <= 0) {
+        // the fill returned less than there was
+        break;
+      }
+      const int copy = int(std::min(available, s64(count - total)));
+      memcpy(dest + total * m_unit_size,
+             &buffer.data[int(position - buffer.start) * m_unit_size],
+             copy * m_unit_size);
+      total    += copy;
+      position += copy;
+
+      if (read_ahead) {
+        queueFill(buffer.start + buffer.length, position);
+      }
+    }
+    m_mutex.unlock();
+
+    return total;
+  }
+
+
+  void ReadAheadBuffer::readAhead(s64 start, s64 position) {
+    SYNCHRONIZED(m_mutex);
+    queueFill(start, position);
+  }
+
+
+  void ReadAheadBuffer::fillQueued(int i, s64 start) {
+    const int length = fillBuffer(start, &m_buffers[i].data[0]);
+
+    m_mutex.lock();
+    m_buffers[i].length = length;
+    m_buffers[i].state  = READY;
+    m_buffers[i].job    = 0;
+    m_mutex.unlock();
+    m_buffer_ready.notify();
+  }
+
+
+  int ReadAheadBuffer::findBuffer(s64 position) {
+    for (int i = 0; i < BUFFER_COUNT; ++i) {
+      const Buffer& buffer = m_buffers[i];
+      const int length =
+        (buffer.state == READY ? buffer.length : m_buffer_length);
+      if (buffer.state != EMPTY &&
+          position >= buffer.start &&
+          position < buffer.start + length)
+      {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+
+  int ReadAheadBuffer::findFreeBuffer() {
+    for (int i = 0; i < BUFFER_COUNT; ++i) {
+      if (m_buffers[i].state != PENDING) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+
+  void ReadAheadBuffer::queueFill(s64 start, s64 position) {
+    if (start >= m_length || findBuffer(start) >= 0) {
+      return;
+    }
+
+    // don't evict the buffer the reader is in
+    const int current = findBuffer(position);
+    for (int i = 0; i < BUFFER_COUNT; ++i) {
+      Buffer& buffer = m_buffers[i];
+      if (i != current && buffer.state != PENDING) {
+        buffer.start = start;
+        buffer.state = PENDING;
+
+        // the job may run right here, and it takes the lock
+        RefPtr<RefCounted> job = createJob(i, start);
+        buffer.job = job;
+        m_mutex.unlock();
+        submitJob(job.get());
+        m_mutex.lock();
+        return;
+      }
+    }
+  }
+
+}
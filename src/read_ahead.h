@@ -0,0 +1,128 @@
+/**
+ * @file
+ *
+ * Buffers filled in the background ahead of a sequential reader
+ */
+
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+
+#include <vector>
+#include "audiere.h"
+#include "threads.h"
+
+
+namespace audiere {
+
+  /**
+   * Serves a sequential reader from a couple of buffers that are filled
+   * in the background ahead of it.  Positions and lengths count units of
+   * unit_size bytes, e.g. bytes of a file or frames of a sample source.
+   *
+   * Subclasses fill buffers and decide where fills run.  A fill job must
+   * call fillQueued(), and may run inside submitJob(): the buffer's lock
+   * is never held while submitting.
+   */
+  class ReadAheadBuffer {
+  public:
+    ReadAheadBuffer();
+    virtual ~ReadAheadBuffer();
+
+    /**
+     * Copies up to count units at position to out, filling buffers on
+     * the calling thread when nothing covers the position.  Advances
+     * position by the units copied.
+     *
+     * @param read_ahead  whether to queue the buffer after the one read
+     *
+     * @return  number of units copied
+     */
+    int readBuffered(s64& position, int count, void* out, bool read_ahead);
+
+    /**
+     * Queues a fill of the buffer at start unless it's loaded or past
+     * the end, without evicting the buffer that covers position.
+     */
+    void readAhead(s64 start, s64 position);
+
+    /// Fills buffer i from start.  Called by the jobs from createJob().
+    void fillQueued(int i, s64 start);
+
+    int getBufferLength() const {
+      return m_buffer_length;
+    }
+
+  protected:
+    /**
+     * Sets the buffers up.  Subclasses call it once, before reading.
+     *
+     * @param length         units available to read
+     * @param buffer_length  units per buffer
+     * @param alignment      buffers that the reader fills itself start
+     *                       at a multiple of this
+     */
+    void initBuffers(s64 length, int buffer_length, int unit_size, int alignment);
+
+    /**
+     * Reads up to getBufferLength() units at start into buffer.  Called
+     * without the lock, possibly on several threads at once.
+     *
+     * @return  number of units read
+     */
+    virtual int fillBuffer(s64 start, void* buffer) = 0;
+
+    /// Returns a job that calls fillQueued(i, start) when run.
+    virtual RefCounted* createJob(int i, s64 start) = 0;
+
+    virtual void submitJob(RefCounted* job) = 0;
+
+    /**
+     * Takes a job off its queue if it hasn't started.  Expects the lock.
+     *
+     * @return  true if the job will never run
+     */
+    virtual bool cancelJob(RefCounted* job) {
+      return false;
+    }
+
+  private:
+    enum State {
+      EMPTY,
+      PENDING,  ///< being filled, only the filling thread touches data
+      READY,
+    };
+
+    struct Buffer {
+      std::vector<u8> data;
+      s64 start;   ///< in units
+      int length;  ///< in units, once READY
+      State state;
+      RefPtr<RefCounted> job;  ///< the queued fill while PENDING
+    };
+
+    enum { BUFFER_COUNT = 2 };
+
+    /// Returns the buffer covering position, or -1.  Expects m_mutex.
+    int findBuffer(s64 position);
+
+    /// Returns a buffer that isn't being filled, or -1.  Expects m_mutex.
+    int findFreeBuffer();
+
+    /// Like readAhead(), but expects m_mutex and releases it to submit.
+    void queueFill(s64 start, s64 position);
+
+    s64 m_length;
+    int m_buffer_length;
+    int m_unit_size;
+    int m_alignment;
+
+    Mutex m_mutex;  ///< protects the buffers
+    CondVar m_buffer_ready;
+    Buffer m_buffers[BUFFER_COUNT];
+  };
+
+}
+
+
+#endif
@@ -13,8 +13,7 @@ namespace audiere {
 
     m_shift = 1;
 
-    fillBuffers();
-    resetState();
+    prepare();
   }
 
   void
@@ -30,6 +29,10 @@ namespace audiere {
 
   int
   Resampler::read(const int frame_count, void* buffer) {
+    if (m_passthrough) {
+      return m_source->read(frame_count, buffer);
+    }
+
     s16* out = (s16*)buffer;
     int left = frame_count;
     sample_t tmp_l[BUFFER_SIZE];
@@ -80,7 +83,46 @@ namespace audiere {
   void
   Resampler::reset() {
     m_source->reset();
-    fillBuffers();
+    prepare();
+  }
+
+
+  int
+  Resampler::acquireBlock(int frame_count, const void*& block) {
+    if (!m_passthrough) {
+      block = 0;
+      return 0;
+    }
+    return m_source->acquireBlock(frame_count, block);
+  }
+
+  void
+  Resampler::releaseBlock(int frame_count) {
+    m_source->releaseBlock(frame_count);
+  }
+
+
+  /**
+   * When the source already produces what the resampler outputs, frames
+   * are handed through from the source untouched and the native buffers
+   * are left empty.
+   */
+  bool
+  Resampler::canPassThrough() {
+    return (m_native_channel_count == 2 &&
+            m_native_sample_format == SF_S16 &&
+            m_native_sample_rate == m_rate &&
+            m_shift == 1);
+  }
+
+  void
+  Resampler::prepare() {
+    m_passthrough = canPassThrough();
+    if (m_passthrough) {
+      m_buffer_length = 0;
+    } else {
+      fillBuffers();
+    }
     resetState();
   }
 
@@ -91,18 +133,48 @@ namespace audiere {
 
   void
   Resampler::fillBuffers() {
-    // we only support channels in [1, 2] and bits in [8, 16] now
-    u8 initial_buffer[BUFFER_SIZE * 4];
-    unsigned read = m_source->read(BUFFER_SIZE, initial_buffer);
+    int read = 0;
+
+    // convert straight out of the source's memory while it lends it out
+    while (read < BUFFER_SIZE) {
+      const void* block;
+      int borrowed = m_source->acquireBlock(BUFFER_SIZE - read, block);
+      if (borrowed <= 0) {
+        break;
+      }
+      convertToNative(block, borrowed,
+                      m_native_buffer_l + read, m_native_buffer_r + read);
+      m_source->releaseBlock(borrowed);
+      read += borrowed;
+    }
 
-    sample_t* out_l = m_native_buffer_l;
-    sample_t* out_r = m_native_buffer_r;
+    if (read < BUFFER_SIZE) {
+      u8 initial_buffer[BUFFER_SIZE * 4];
+      int got = m_source->read(BUFFER_SIZE - read, initial_buffer);
+      convertToNative(initial_buffer, got,
+                      m_native_buffer_l + read, m_native_buffer_r + read);
+      read += got;
+    }
+
+    m_buffer_length = read;
+  }
+
+  void
+  Resampler::convertToNative(
+    const void* samples,
+    int frame_count,
+    sample_t* out_l,
+    sample_t* out_r)
+  {
+    // we only support channels in [1, 2] and bits in [8, 16] now
+    const unsigned read = frame_count;
+    const u8* initial_buffer = (const u8*)samples;
 
     if (m_native_channel_count == 1) {
       if (m_native_sample_format == SF_U8) {
 
         // channels = 1, bits = 8
-        u8* in = initial_buffer;
+        const u8* in = initial_buffer;
         for (unsigned i = 0; i < read; ++i) {
           s16 sample = u8tos16(*in++);
           *out_l++ = sample;
@@ -111,7 +183,7 @@ namespace audiere {
       } else {
 
         // channels = 1, bits = 16
-        s16* in = (s16*)initial_buffer;
+        const s16* in = (const s16*)initial_buffer;
         for (unsigned i = 0; i < read; ++i) {
           s16 sample = *in++;
           *out_l++ = sample;
@@ -122,7 +194,7 @@ namespace audiere {
       if (m_native_sample_format == SF_U8) {
 
         // channels = 2, bits = 8
-        u8* in = initial_buffer;
+        const u8* in = initial_buffer;
         for (unsigned i = 0; i < read; ++i) {
           *out_l++ = u8tos16(*in++);
           *out_r++ = u8tos16(*in++);
@@ -131,7 +203,7 @@ namespace audiere {
       } else {
 
         // channels = 2, bits = 16
-        s16* in = (s16*)initial_buffer;
+        const s16* in = (const s16*)initial_buffer;
         for (unsigned i = 0; i < read; ++i) {
           *out_l++ = *in++;
           *out_r++ = *in++;
@@ -139,8 +211,6 @@ namespace audiere {
 
       }
     }
-
-    m_buffer_length = read;
   }
 
   void
@@ -160,22 +230,39 @@ namespace audiere {
 
   int
   Resampler::getLength() {
-    return m_source->getLength();
+    return ClampToInt(getLength64());
   }
 
   void
   Resampler::setPosition(int position) {
-    m_source->setPosition(position);
-    fillBuffers();
-    resetState();
+    setPosition64(position);
   }
 
   int
   Resampler::getPosition() {
-    int position = m_source->getPosition() - m_buffer_length +
+    return ClampToInt(getPosition64());
+  }
+
+  s64
+  Resampler::getLength64() {
+    return m_source->getLength64();
+  }
+
+  void
+  Resampler::setPosition64(s64 position) {
+    m_source->setPosition64(position);
+    prepare();
+  }
+
+  s64
+  Resampler::getPosition64() {
+    s64 position = m_source->getPosition64() - m_buffer_length +
                    m_resampler_l.pos;
-    while (position < 0) {
-      position += m_source->getLength();
+    if (position < 0) {
+      // the buffer holds the end of the source from before it looped,
+      // unless the source has no length to loop over
+      const s64 length = m_source->getLength64();
+      position = (length > 0 ? length - 1 - (-position - 1) % length : 0);
     }
     return position;
   }
@@ -200,6 +287,14 @@ namespace audiere {
   void
   Resampler::setPitchShift(float shift) {
     m_shift = shift;
+
+    // nothing is buffered while passing through, so start resampling from
+    // the source's current position
+    if (m_passthrough && !canPassThrough()) {
+      m_passthrough = false;
+      fillBuffers();
+      resetState();
+    }
   }
 
   float
@@ -207,4 +302,9 @@ namespace audiere {
     return m_shift;
   }
 
+  double
+  Resampler::getSourceRatio() {
+    return double(m_native_sample_rate) * m_shift / m_rate;
+  }
+
 }
@@ -28,6 +28,9 @@ namespace audiere {
     int  ADR_CALL getLength();
     void ADR_CALL setPosition(int position);
     int  ADR_CALL getPosition();
+    s64  ADR_CALL getLength64();
+    void ADR_CALL setPosition64(s64 position);
+    s64  ADR_CALL getPosition64();
 
     bool ADR_CALL getRepeat();
     void ADR_CALL setRepeat(bool repeat);
@@ -38,11 +41,21 @@ namespace audiere {
     const char* ADR_CALL getTagType(int i);
     const char* ADR_CALL getDecoder();
 
+    int  ADR_CALL acquireBlock(int frame_count, const void*& block);
+    void ADR_CALL releaseBlock(int frame_count);
+
     void  setPitchShift(float shift);
     float getPitchShift();
 
+    /// Source frames consumed per output frame.
+    double getSourceRatio();
+
   private:
+    bool canPassThrough();
+    void prepare();
     void fillBuffers();
+    void convertToNative(const void* samples, int frame_count,
+                         sample_t* out_l, sample_t* out_r);
     void resetState();
 
   private:
@@ -60,6 +73,7 @@ namespace audiere {
     int m_buffer_length; // number of samples read into each buffer
 
     float m_shift;
+    bool m_passthrough;
   };
 
 }
@@ -1,6 +1,9 @@
+#include "adpcm.h"
 #include "audiere.h"
 #include "basic_source.h"
+#include "debug.h"
 #include "internal.h"
+#include "sample_buffer.h"
 #include "types.h"
 #include "utility.h"
 
@@ -45,15 +48,26 @@ namespace audiere {
     }
 
 
+    int ADR_CALL acquireBlock(int frame_count, const void*& block) {
+      block = m_samples + m_position * m_frame_size;
+      return std::max(0, std::min(frame_count, m_frame_count - m_position));
+    }
+
+
+    void ADR_CALL releaseBlock(int frame_count) {
+      m_position += frame_count;
+    }
+
+
     void ADR_CALL reset() {
       m_position = 0;
     }
 
 
-    bool ADR_CALL isSeekable()              { return true;           }
-    int ADR_CALL getLength()                { return m_frame_count;  }
-    void ADR_CALL setPosition(int position) { m_position = position; }
-    int ADR_CALL getPosition()              { return m_position;     }
+    bool ADR_CALL isSeekable()                { return true;                }
+    s64 ADR_CALL getLength64()                { return m_frame_count;       }
+    void ADR_CALL setPosition64(s64 position) { m_position = int(position); }
+    s64 ADR_CALL getPosition64()              { return m_position;          }
 
   private:
     RefPtr<SampleBuffer> m_buffer;
@@ -65,100 +79,425 @@ namespace audiere {
   };
 
 
-  class SampleBufferImpl : public RefImplementation<SampleBuffer> {
+  /// Plays an AdpcmSampleBuffer, decoding the block it is in.
+  class AdpcmBufferStream : public BasicSource {
   public:
-    SampleBufferImpl(
-      void* samples, int frame_count,
-      int channel_count, int sample_rate, SampleFormat sample_format)
-    {
-      const int frame_size = channel_count * GetSampleSize(sample_format);
-      const int buffer_size = frame_count * frame_size;
-      m_samples = new u8[buffer_size];
-      if (samples) {
-        memcpy(m_samples, samples, buffer_size);
-      } else {
-        memset(m_samples, 0, buffer_size);
-      }
+    AdpcmBufferStream(AdpcmSampleBuffer* buffer, SampleBuffer* holder) {
+      m_holder = holder;
+      m_buffer = buffer;
 
-      m_frame_count   = frame_count;
-      m_channel_count = channel_count;
-      m_sample_rate   = sample_rate;
-      m_sample_format = sample_format;
-    }
+      int sample_rate;
+      SampleFormat sample_format;
+      buffer->getFormat(m_channel_count, sample_rate, sample_format);
+
+      m_frame_count      = buffer->getLength();
+      m_frames_per_block = buffer->getFramesPerBlock();
+      m_decoded.resize(m_frames_per_block * m_channel_count);
+      m_decoded_block = -1;
 
-    ~SampleBufferImpl() {
-      delete[] m_samples;
+      m_position = 0;
     }
 
+
     void ADR_CALL getFormat(
       int& channel_count,
       int& sample_rate,
       SampleFormat& sample_format)
     {
-      channel_count = m_channel_count;
-      sample_rate   = m_sample_rate;
-      sample_format = m_sample_format;
+      m_buffer->getFormat(channel_count, sample_rate, sample_format);
     }
 
-    int ADR_CALL getLength() {
-      return m_frame_count;
+
+    int doRead(int frame_count, void* buffer) {
+      s16* out = (s16*)buffer;
+      int read = 0;
+      while (read < frame_count) {
+        const s16* block;
+        const int count = lend(frame_count - read, block);
+        if (count == 0) {
+          break;
+        }
+        memcpy(out + read * m_channel_count, block,
+               count * m_channel_count * sizeof(s16));
+        m_position += count;
+        read       += count;
+      }
+      return read;
     }
 
-    const void* ADR_CALL getSamples() {
-      return m_samples;
+
+    int ADR_CALL acquireBlock(int frame_count, const void*& block) {
+      const s16* decoded;
+      const int count = lend(frame_count, decoded);
+      block = decoded;
+      return count;
     }
 
-    SampleSource* ADR_CALL openStream() {
-      return new BufferStream(this);
+
+    void ADR_CALL releaseBlock(int frame_count) {
+      m_position += frame_count;
     }
 
+
+    void ADR_CALL reset() {
+      m_position = 0;
+    }
+
+
+    bool ADR_CALL isSeekable()                { return true;                }
+    s64 ADR_CALL getLength64()                { return m_frame_count;       }
+    void ADR_CALL setPosition64(s64 position) { m_position = int(position); }
+    s64 ADR_CALL getPosition64()              { return m_position;          }
+
   private:
-    u8* m_samples;
-    int m_frame_count;
+    /// Decodes the block at the current position if needed and points
+    /// block at the position.  Returns how many frames follow it.
+    int lend(int frame_count, const s16*& block) {
+      block = 0;
+      if (m_position >= m_frame_count) {
+        return 0;
+      }
+
+      const int index = m_position / m_frames_per_block;
+      if (index != m_decoded_block) {
+        m_buffer->decodeBlock(index, &m_decoded[0]);
+        m_decoded_block = index;
+      }
+
+      const int offset = m_position - index * m_frames_per_block;
+      block = &m_decoded[offset * m_channel_count];
+      return std::min(frame_count, std::min(m_frames_per_block - offset,
+                                            m_frame_count - m_position));
+    }
+
+    RefPtr<SampleBuffer> m_holder;  ///< keeps m_buffer alive
+    AdpcmSampleBuffer* m_buffer;
     int m_channel_count;
-    int m_sample_rate;
-    SampleFormat m_sample_format;
+    int m_frame_count;
+    int m_frames_per_block;
+
+    std::vector<s16> m_decoded;
+    int m_decoded_block;  ///< index of the block in m_decoded, or -1
+
+    int m_position;  // in frames
   };
 
 
-  ADR_EXPORT(SampleBuffer*) AdrCreateSampleBuffer(
-    void* samples,
+  SampleBufferImpl::SampleBufferImpl(
+    const void* samples, int frame_count,
+    int channel_count, int sample_rate, SampleFormat sample_format)
+  {
+    init(frame_count, channel_count, sample_rate, sample_format);
+
+    const int buffer_size =
+      frame_count * channel_count * GetSampleSize(sample_format);
+    m_storage = new u8[buffer_size];
+    if (samples) {
+      memcpy(m_storage, samples, buffer_size);
+    } else {
+      memset(m_storage, 0, buffer_size);
+    }
+    m_samples = m_storage;
+  }
+
+
+  SampleBufferImpl::SampleBufferImpl(
     int frame_count,
-    int channel_count,
-    int sample_rate,
-    SampleFormat sample_format)
+    int channel_count, int sample_rate, SampleFormat sample_format)
   {
-    return new SampleBufferImpl(
-      samples, frame_count,
-      channel_count, sample_rate, sample_format);
+    init(frame_count, channel_count, sample_rate, sample_format);
+
+    const int buffer_size =
+      frame_count * channel_count * GetSampleSize(sample_format);
+    m_storage = new u8[buffer_size];
+    m_samples = m_storage;
   }
 
-  ADR_EXPORT(SampleBuffer*) AdrCreateSampleBufferFromSource(
-    SampleSource* source)
+
+  SampleBufferImpl::SampleBufferImpl(
+    const void* samples, int frame_count,
+    int channel_count, int sample_rate, SampleFormat sample_format,
+    RefCounted* owner)
+  {
+    init(frame_count, channel_count, sample_rate, sample_format);
+
+    m_samples = (const u8*)samples;
+    m_storage = 0;
+    m_owner   = owner;
+  }
+
+
+  SampleBufferImpl::~SampleBufferImpl() {
+    delete[] m_storage;
+  }
+
+
+  void
+  SampleBufferImpl::init(
+    int frame_count,
+    int channel_count, int sample_rate, SampleFormat sample_format)
+  {
+    m_frame_count   = frame_count;
+    m_channel_count = channel_count;
+    m_sample_rate   = sample_rate;
+    m_sample_format = sample_format;
+  }
+
+
+  void
+  SampleBufferImpl::getFormat(
+    int& channel_count,
+    int& sample_rate,
+    SampleFormat& sample_format)
   {
+    channel_count = m_channel_count;
+    sample_rate   = m_sample_rate;
+    sample_format = m_sample_format;
+  }
+
+
+  int
+  SampleBufferImpl::getLength() {
+    return m_frame_count;
+  }
+
+
+  const void*
+  SampleBufferImpl::getSamples() {
+    return m_samples;
+  }
+
+
+  SampleSource*
+  SampleBufferImpl::openStream() {
+    return new BufferStream(this);
+  }
+
+
+  u8*
+  SampleBufferImpl::getStorage() {
+    return m_storage;
+  }
+
+
+  int
+  SampleBufferImpl::getStorageSize() {
+    return (m_storage ?
+            m_frame_count * m_channel_count * GetSampleSize(m_sample_format) :
+            0);
+  }
+
+
+  void
+  SampleBufferImpl::readFrom(SampleSource* source) {
+    ADR_ASSERT(m_storage, "can't read into borrowed samples");
+
+    const int frame_size = m_channel_count * GetSampleSize(m_sample_format);
+    source->setPosition64(0);  // in case the source has been read from already
+    int read = source->read(m_frame_count, m_storage);
+    memset(m_storage + read * frame_size, 0,
+           (m_frame_count - read) * frame_size);
+  }
+
+
+  AdpcmSampleBuffer::AdpcmSampleBuffer(
+    int frame_count, int channel_count, int sample_rate)
+  {
+    m_frame_count   = frame_count;
+    m_channel_count = channel_count;
+    m_sample_rate   = sample_rate;
+
+    m_block_size       = CHANNEL_BLOCK_SIZE * channel_count;
+    m_frames_per_block = GetImaFramesPerBlock(m_block_size, channel_count);
+
+    const int block_count =
+      (frame_count + m_frames_per_block - 1) / m_frames_per_block;
+    m_blocks.resize(block_count * m_block_size);
+  }
+
+
+  void
+  AdpcmSampleBuffer::getFormat(
+    int& channel_count,
+    int& sample_rate,
+    SampleFormat& sample_format)
+  {
+    channel_count = m_channel_count;
+    sample_rate   = m_sample_rate;
+    sample_format = SF_S16;
+  }
+
+
+  int
+  AdpcmSampleBuffer::getLength() {
+    return m_frame_count;
+  }
+
+
+  const void*
+  AdpcmSampleBuffer::getSamples() {
+    return 0;
+  }
+
+
+  SampleSource*
+  AdpcmSampleBuffer::openStream() {
+    return new AdpcmBufferStream(this, this);
+  }
+
+
+  SampleSource*
+  AdpcmSampleBuffer::openStream(SampleBuffer* holder) {
+    return new AdpcmBufferStream(this, holder);
+  }
+
+
+  void
+  AdpcmSampleBuffer::decodeBlock(int block, s16* out) {
+    const int frames = std::min(m_frames_per_block,
+                                m_frame_count - block * m_frames_per_block);
+    DecodeImaBlock(&m_blocks[block * m_block_size],
+                   m_channel_count, frames, out);
+  }
+
+
+  void
+  AdpcmSampleBuffer::encodeFrom(SampleSource* source) {
+    int channel_count, sample_rate;
+    SampleFormat sample_format;
+    source->getFormat(channel_count, sample_rate, sample_format);
+    source->setPosition64(0);
+
+    const int sample_count = m_frames_per_block * m_channel_count;
+    std::vector<s16> frames(sample_count);
+    std::vector<u8>  raw(sample_format == SF_U8 ? sample_count : 0);
+
+    int step_index[ADPCM_MAX_CHANNELS] = { 0 };
+    bool source_done = false;
+
+    for (int start = 0; start < m_frame_count; start += m_frames_per_block) {
+      const int count = std::min(m_frames_per_block, m_frame_count - start);
+
+      int read = 0;
+      if (!source_done) {
+        if (sample_format == SF_U8) {
+          read = source->read(count, &raw[0]);
+          for (int i = 0; i < read * m_channel_count; ++i) {
+            frames[i] = s16((raw[i] - 128) * 256);
+          }
+        } else {
+          read = source->read(count, &frames[0]);
+        }
+        source_done = (read < count);
+      }
+      std::fill(frames.begin() + read * m_channel_count,
+                frames.begin() + count * m_channel_count, s16(0));
+
+      EncodeImaBlock(
+        &frames[0], count, m_channel_count, m_block_size,
+        &m_blocks[start / m_frames_per_block * m_block_size], step_index);
+    }
+  }
+
+
+  SampleSource* CreateBufferStream(SampleBuffer* buffer) {
+    return new BufferStream(buffer);
+  }
+
+
+  SampleBufferImpl* DecodeSampleBuffer(SampleSource* source) {
     // if there is no source or it isn't seekable, we can't make a
     // buffer from it
     if (!source || !source->isSeekable()) {
       return 0;
     }
 
-    int length = source->getLength();
+    s64 length = source->getLength64();
+    int channel_count, sample_rate;
+    SampleFormat sample_format;
+    source->getFormat(channel_count, sample_rate, sample_format);
+
+    // a buffer is addressed with int frame counts and byte sizes
+    s64 length_bytes = length * channel_count * GetSampleSize(sample_format);
+    if (length_bytes > INT_MAX) {
+      return 0;
+    }
+
+    SampleBufferImpl* buffer = new SampleBufferImpl(
+      int(length), channel_count, sample_rate, sample_format);
+    buffer->readFrom(source);
+    return buffer;
+  }
+
+
+  AdpcmSampleBuffer* EncodeSampleBuffer(SampleSource* source) {
+    if (!source || !source->isSeekable()) {
+      return 0;
+    }
+
+    s64 length = source->getLength64();
     int channel_count, sample_rate;
     SampleFormat sample_format;
     source->getFormat(channel_count, sample_rate, sample_format);
 
-    int stream_length_bytes = length *
-      channel_count * GetSampleSize(sample_format);
-    u8* buffer = new u8[stream_length_bytes];
+    if (channel_count <= 0 || channel_count > ADPCM_MAX_CHANNELS ||
+        (sample_format != SF_U8 && sample_format != SF_S16))
+    {
+      return 0;
+    }
+
+    // the encoded size is just under a quarter of the 16-bit size
+    s64 length_bytes = length * channel_count * GetSampleSize(SF_S16);
+    if (length_bytes > INT_MAX) {
+      return 0;
+    }
+
+    AdpcmSampleBuffer* buffer = new AdpcmSampleBuffer(
+      int(length), channel_count, sample_rate);
+    buffer->encodeFrom(source);
+    return buffer;
+  }
+
+
+  ADR_EXPORT(SampleBuffer*) AdrCreateSampleBuffer(
+    void* samples,
+    int frame_count,
+    int channel_count,
+    int sample_rate,
+    SampleFormat sample_format)
+  {
+    return new SampleBufferImpl(
+      samples, frame_count,
+      channel_count, sample_rate, sample_format);
+  }
 
-    source->setPosition(0);
-    source->read(length, buffer);
+  ADR_EXPORT(SampleBuffer*) AdrCreateBorrowedSampleBuffer(
+    const void* samples,
+    int frame_count,
+    int channel_count,
+    int sample_rate,
+    SampleFormat sample_format,
+    RefCounted* owner)
+  {
+    if (!samples && frame_count) {
+      return 0;
+    }
+    return new SampleBufferImpl(
+      samples, frame_count,
+      channel_count, sample_rate, sample_format,
+      owner);
+  }
 
-    SampleBuffer* sb = CreateSampleBuffer(
-      buffer, length, channel_count, sample_rate, sample_format);
+  ADR_EXPORT(SampleBuffer*) AdrCreateSampleBufferFromSource(
+    SampleSource* source)
+  {
+    return DecodeSampleBuffer(source);
+  }
 
-    delete[] buffer;
-    return sb;
+  ADR_EXPORT(SampleBuffer*) AdrCreateCompressedSampleBuffer(
+    SampleSource* source)
+  {
+    return EncodeSampleBuffer(source);
   }
 
 }
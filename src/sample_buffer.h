@@ -0,0 +1,154 @@
+#ifndef SAMPLE_BUFFER_H
+#define SAMPLE_BUFFER_H
+
+
+#include <vector>
+#include "audiere.h"
+#include "types.h"
+
+
+namespace audiere {
+
+  class SampleBufferImpl : public RefImplementation<SampleBuffer> {
+  public:
+    /// Makes a private copy of samples, or silence if samples is 0.
+    SampleBufferImpl(
+      const void* samples, int frame_count,
+      int channel_count, int sample_rate, SampleFormat sample_format);
+
+    /**
+     * Allocates uninitialized storage to be filled through getStorage(),
+     * so that decoders can write into the buffer without a temporary.
+     */
+    SampleBufferImpl(
+      int frame_count,
+      int channel_count, int sample_rate, SampleFormat sample_format);
+
+    /**
+     * Plays the caller's samples without copying them.  If owner is not 0,
+     * the buffer holds a reference to it until the buffer is destroyed.
+     */
+    SampleBufferImpl(
+      const void* samples, int frame_count,
+      int channel_count, int sample_rate, SampleFormat sample_format,
+      RefCounted* owner);
+
+    ~SampleBufferImpl();
+
+    void ADR_CALL getFormat(
+      int& channel_count,
+      int& sample_rate,
+      SampleFormat& sample_format);
+
+    int ADR_CALL getLength();
+    const void* ADR_CALL getSamples();
+    SampleSource* ADR_CALL openStream();
+
+    /// Writable storage of a buffer created without samples, otherwise 0.
+    u8* getStorage();
+
+    /// Bytes of sample memory the buffer keeps, 0 while borrowing.
+    int getStorageSize();
+
+    /**
+     * Fills the buffer by reading the source from the beginning.  Frames
+     * the source doesn't deliver are left silent.
+     */
+    void readFrom(SampleSource* source);
+
+  private:
+    void init(int frame_count,
+              int channel_count, int sample_rate, SampleFormat sample_format);
+
+    const u8* m_samples;
+
+    /// Our own copy of the samples, or 0 while borrowing.
+    u8* m_storage;
+    RefPtr<RefCounted> m_owner;
+
+    int m_frame_count;
+    int m_channel_count;
+    int m_sample_rate;
+    SampleFormat m_sample_format;
+  };
+
+
+  /**
+   * A buffer keeping its samples as IMA ADPCM blocks, about a quarter the
+   * size of 16-bit PCM.  getSamples() returns 0, so it is always played
+   * through a stream, which decodes one block at a time.
+   */
+  class AdpcmSampleBuffer : public RefImplementation<SampleBuffer> {
+  public:
+    /// Bytes per channel in each block.
+    enum { CHANNEL_BLOCK_SIZE = 512 };
+
+    AdpcmSampleBuffer(int frame_count, int channel_count, int sample_rate);
+
+    void ADR_CALL getFormat(
+      int& channel_count,
+      int& sample_rate,
+      SampleFormat& sample_format);
+
+    int ADR_CALL getLength();
+    const void* ADR_CALL getSamples();
+    SampleSource* ADR_CALL openStream();
+
+    /**
+     * Opens a stream that keeps holder, rather than this buffer, alive.
+     * holder must keep a reference to this buffer.
+     */
+    SampleSource* openStream(SampleBuffer* holder);
+
+    int getFramesPerBlock() {
+      return m_frames_per_block;
+    }
+
+    /// Decodes the block starting at frame block * getFramesPerBlock().
+    void decodeBlock(int block, s16* out);
+
+    /**
+     * Encodes the source from the beginning.  Frames the source doesn't
+     * deliver are left silent.
+     */
+    void encodeFrom(SampleSource* source);
+
+    int getStorageSize() {
+      return int(m_blocks.size());
+    }
+
+  private:
+    std::vector<u8> m_blocks;
+    int m_block_size;
+    int m_frames_per_block;
+
+    int m_frame_count;
+    int m_channel_count;
+    int m_sample_rate;
+  };
+
+
+  /**
+   * Opens a seekable source over any SampleBuffer's samples.  The source
+   * holds a reference to the buffer.
+   */
+  SampleSource* CreateBufferStream(SampleBuffer* buffer);
+
+
+  /**
+   * Creates a buffer holding the whole of source.  Returns 0 if the source
+   * isn't seekable or is too long to address with an int.
+   */
+  SampleBufferImpl* DecodeSampleBuffer(SampleSource* source);
+
+
+  /**
+   * Creates an ADPCM buffer holding the whole of source.  Returns 0 if the
+   * source isn't seekable, is too long, or has too many channels.
+   */
+  AdpcmSampleBuffer* EncodeSampleBuffer(SampleSource* source);
+
+}
+
+
+#endif
@@ -0,0 +1,384 @@
+/**
+ * @file
+ *
+ * Process-wide cache of decoded sample buffers, keyed by filename and
+ * file format, with a byte budget for the buffers nobody is using.
+ */
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <string>
+#include "debug.h"
+#include "internal.h"
+#include "sample_buffer.h"
+#include "threads.h"
+#include "utility.h"
+
+
+namespace audiere {
+
+  class SampleCache;
+
+
+  /**
+   * The buffer handed out for a cache entry.  Its reference count is kept
+   * under the cache's lock, so that a buffer whose last user just let go
+   * can't be evicted while someone else is looking it up.  The cache, not
+   * the last reference, decides when it is destroyed.
+   */
+  class CachedSampleBuffer : public SampleBuffer {
+  public:
+    typedef std::pair<std::string, FileFormat> Key;
+
+    /// adpcm is the buffer itself if it is compressed, otherwise 0.
+    CachedSampleBuffer(SampleCache* cache, const Key& key,
+                       SampleBuffer* buffer, AdpcmSampleBuffer* adpcm,
+                       s64 size);
+    virtual ~CachedSampleBuffer() { }
+
+    void ADR_CALL ref();
+    void ADR_CALL unref();
+
+    void ADR_CALL getFormat(
+      int& channel_count,
+      int& sample_rate,
+      SampleFormat& sample_format)
+    {
+      m_buffer->getFormat(channel_count, sample_rate, sample_format);
+    }
+
+    int ADR_CALL getLength() {
+      return m_buffer->getLength();
+    }
+
+    const void* ADR_CALL getSamples() {
+      return m_buffer->getSamples();
+    }
+
+    SampleSource* ADR_CALL openStream() {
+      // streams reference the entry, so a playing buffer stays in use
+      return (m_adpcm ? m_adpcm->openStream(this) : CreateBufferStream(this));
+    }
+
+  private:
+    friend class SampleCache;
+
+    SampleCache* m_cache;
+    Key m_key;
+    RefPtr<SampleBuffer> m_buffer;
+    AdpcmSampleBuffer* m_adpcm;
+    s64 m_size;
+
+    int m_ref_count;
+    bool m_pinned;
+    bool m_unused;  ///< whether the entry is in m_unused
+    std::list<CachedSampleBuffer*>::iterator m_unused_position;
+  };
+
+
+  class SampleCache {
+  public:
+    enum { DEFAULT_BUDGET = 32 * 1024 * 1024 };
+
+    static SampleCache& get();
+
+    /// Returns the entry for the file with a reference for the caller.
+    CachedSampleBuffer* acquire(const char* filename, FileFormat file_format);
+
+    bool pin(const char* filename, FileFormat file_format, bool pinned);
+    void setBudget(s64 bytes);
+    void setCompression(bool compressed);
+    void getStats(SampleCacheStats& stats);
+    void flush();
+
+  private:
+    SampleCache();
+
+    /// Called with m_mutex held when an entry loses its last reference.
+    void release(CachedSampleBuffer* entry);
+
+    /// Evicts unused, unpinned entries, oldest first, down to budget.
+    void trim(s64 budget);
+
+    void addRef(CachedSampleBuffer* entry);
+
+    friend class CachedSampleBuffer;
+
+    Mutex m_mutex;
+
+    typedef std::map<CachedSampleBuffer::Key, CachedSampleBuffer*> EntryMap;
+    EntryMap m_entries;
+
+    /// Entries nobody references, least recently used first.
+    std::list<CachedSampleBuffer*> m_unused;
+
+    s64 m_budget;
+    s64 m_bytes;
+    bool m_compressed;
+    int m_hits;
+    int m_misses;
+    int m_evictions;
+  };
+
+
+  CachedSampleBuffer::CachedSampleBuffer(
+    SampleCache* cache, const Key& key,
+    SampleBuffer* buffer, AdpcmSampleBuffer* adpcm,
+    s64 size)
+  {
+    m_cache  = cache;
+    m_key    = key;
+    m_buffer = buffer;
+    m_adpcm  = adpcm;
+    m_size   = size;
+
+    m_ref_count = 0;
+    m_pinned    = false;
+    m_unused    = false;
+  }
+
+
+  void
+  CachedSampleBuffer::ref() {
+    SYNCHRONIZED(m_cache->m_mutex);
+    m_cache->addRef(this);
+  }
+
+
+  void
+  CachedSampleBuffer::unref() {
+    SYNCHRONIZED(m_cache->m_mutex);
+    if (--m_ref_count == 0) {
+      m_cache->release(this);
+    }
+  }
+
+
+  static Mutex s_cache_mutex;
+  static SampleCache* s_cache = 0;
+
+
+  SampleCache& SampleCache::get() {
+    SYNCHRONIZED(s_cache_mutex);
+    if (!s_cache) {
+      s_cache = new SampleCache();
+    }
+    return *s_cache;
+  }
+
+
+  SampleCache::SampleCache() {
+    m_budget     = DEFAULT_BUDGET;
+    m_bytes      = 0;
+    m_compressed = false;
+    m_hits      = 0;
+    m_misses    = 0;
+    m_evictions = 0;
+  }
+
+
+  CachedSampleBuffer*
+  SampleCache::acquire(const char* filename, FileFormat file_format) {
+    ADR_GUARD("SampleCache::acquire");
+
+    CachedSampleBuffer::Key key(filename, file_format);
+    bool compressed;
+    {
+      SYNCHRONIZED(m_mutex);
+      EntryMap::iterator i = m_entries.find(key);
+      if (i != m_entries.end()) {
+        ++m_hits;
+        addRef(i->second);
+        return i->second;
+      }
+      compressed = m_compressed;
+    }
+
+    // Decode without the lock, so other lookups aren't held up.
+    SampleSourcePtr source = hidden::AdrOpenSampleSource(filename, file_format);
+    SampleBufferPtr buffer;
+    AdpcmSampleBuffer* adpcm = 0;
+    s64 size = 0;
+    if (compressed) {
+      adpcm = EncodeSampleBuffer(source.get());
+      buffer = adpcm;
+      size = (adpcm ? adpcm->getStorageSize() : 0);
+    } else {
+      SampleBufferImpl* pcm = DecodeSampleBuffer(source.get());
+      buffer = pcm;
+      size = (pcm ? pcm->getStorageSize() : 0);
+    }
+    source = 0;
+
+    SYNCHRONIZED(m_mutex);
+    ++m_misses;
+    if (!buffer) {
+      return 0;
+    }
+
+    // someone else may have decoded the same file in the meantime
+    EntryMap::iterator i = m_entries.find(key);
+    CachedSampleBuffer* entry;
+    if (i != m_entries.end()) {
+      entry = i->second;
+    } else {
+      entry = new CachedSampleBuffer(this, key, buffer.get(), adpcm, size);
+      m_entries[key] = entry;
+      m_bytes += entry->m_size;
+    }
+    addRef(entry);
+
+    trim(m_budget);
+    return entry;
+  }
+
+
+  bool
+  SampleCache::pin(const char* filename, FileFormat file_format, bool pinned) {
+    if (pinned) {
+      CachedSampleBuffer* entry = acquire(filename, file_format);
+      if (!entry) {
+        return false;
+      }
+      {
+        SYNCHRONIZED(m_mutex);
+        entry->m_pinned = true;
+      }
+      entry->unref();
+      return true;
+    }
+
+    SYNCHRONIZED(m_mutex);
+    EntryMap::iterator i =
+      m_entries.find(CachedSampleBuffer::Key(filename, file_format));
+    if (i == m_entries.end()) {
+      return false;
+    }
+    i->second->m_pinned = false;
+    trim(m_budget);
+    return true;
+  }
+
+
+  void
+  SampleCache::setBudget(s64 bytes) {
+    SYNCHRONIZED(m_mutex);
+    m_budget = std::max(s64(0), bytes);
+    trim(m_budget);
+  }
+
+
+  void
+  SampleCache::setCompression(bool compressed) {
+    SYNCHRONIZED(m_mutex);
+    m_compressed = compressed;
+  }
+
+
+  void
+  SampleCache::getStats(SampleCacheStats& stats) {
+    SYNCHRONIZED(m_mutex);
+    stats.hits         = m_hits;
+    stats.misses       = m_misses;
+    stats.evictions    = m_evictions;
+    stats.entry_count  = int(m_entries.size());
+    stats.pinned_count = 0;
+    for (EntryMap::iterator i = m_entries.begin(); i != m_entries.end(); ++i) {
+      if (i->second->m_pinned) {
+        ++stats.pinned_count;
+      }
+    }
+    stats.bytes  = m_bytes;
+    stats.budget = m_budget;
+  }
+
+
+  void
+  SampleCache::flush() {
+    SYNCHRONIZED(m_mutex);
+    trim(0);
+  }
+
+
+  void
+  SampleCache::addRef(CachedSampleBuffer* entry) {
+    if (entry->m_ref_count++ == 0 && entry->m_unused) {
+      m_unused.erase(entry->m_unused_position);
+      entry->m_unused = false;
+    }
+  }
+
+
+  void
+  SampleCache::release(CachedSampleBuffer* entry) {
+    entry->m_unused = true;
+    entry->m_unused_position = m_unused.insert(m_unused.end(), entry);
+    trim(m_budget);
+  }
+
+
+  void
+  SampleCache::trim(s64 budget) {
+    std::list<CachedSampleBuffer*>::iterator i = m_unused.begin();
+    while (m_bytes > budget && i != m_unused.end()) {
+      CachedSampleBuffer* entry = *i;
+      if (entry->m_pinned) {
+        ++i;
+        continue;
+      }
+
+      i = m_unused.erase(i);
+      m_entries.erase(entry->m_key);
+      m_bytes -= entry->m_size;
+      ++m_evictions;
+      delete entry;
+    }
+  }
+
+
+  ADR_EXPORT(SampleBuffer*) AdrGetCachedSampleBuffer(
+    const char* filename,
+    FileFormat file_format)
+  {
+    if (!filename) {
+      return 0;
+    }
+    return SampleCache::get().acquire(filename, file_format);
+  }
+
+
+  ADR_EXPORT(bool) AdrPinCachedSampleBuffer(
+    const char* filename,
+    FileFormat file_format,
+    bool pinned)
+  {
+    if (!filename) {
+      return false;
+    }
+    return SampleCache::get().pin(filename, file_format, pinned);
+  }
+
+
+  ADR_EXPORT(void) AdrSetSampleCacheBudget(s64 bytes) {
+    SampleCache::get().setBudget(bytes);
+  }
+
+
+  ADR_EXPORT(void) AdrGetSampleCacheStats(SampleCacheStats* stats) {
+    if (stats) {
+      SampleCache::get().getStats(*stats);
+    }
+  }
+
+
+  ADR_EXPORT(void) AdrFlushSampleCache() {
+    SampleCache::get().flush();
+  }
+
+
+  ADR_EXPORT(void) AdrSetSampleCacheCompression(bool compressed) {
+    SampleCache::get().setCompression(compressed);
+  }
+
+}
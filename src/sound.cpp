@@ -1,11 +1,19 @@
 #include "audiere.h"
 #include "debug.h"
+#include "hybrid_source.h"
 #include "internal.h"
+#include "sample_buffer.h"
+#include "threads.h"
 #include "utility.h"
 
 
 namespace audiere {
 
+  static Mutex s_policy_mutex;
+  static int s_hybrid_threshold = 2 * 1024 * 1024;  // bytes
+  static int s_hybrid_head      = 500;              // milliseconds
+
+
   ADR_EXPORT(OutputStream*) AdrOpenSound(
     AudioDevice* device,
     SampleSource* source_raw,
@@ -26,23 +34,44 @@ namespace audiere {
       return device->openStream(source.get());
     }
 
-    int stream_length = source->getLength();
+    int threshold, head;
+    {
+      SYNCHRONIZED(s_policy_mutex);
+      threshold = s_hybrid_threshold;
+      head      = s_hybrid_head;
+    }
+
+    // Long sounds only keep their beginning in memory.  The rest is
+    // decoded in the background while the beginning plays.
     int channel_count, sample_rate;
     SampleFormat sample_format;
     source->getFormat(channel_count, sample_rate, sample_format);
+    const s64 size = source->getLength64() *
+                     channel_count * GetSampleSize(sample_format);
+    if (threshold > 0 && size > threshold) {
+      SampleSourcePtr hybrid = CreateHybridSource(
+        source.get(), int(s64(head) * sample_rate / 1000));
+      return device->openStream(hybrid.get());
+    }
 
-    int stream_length_bytes =
-      stream_length * channel_count * GetSampleSize(sample_format);
-    u8* buffer = new u8[stream_length_bytes];
-    source->setPosition(0);  // in case the source has been read from already
-    source->read(stream_length, buffer);
+    // Decode straight into the buffer the device plays from.  Sounds too
+    // long to fit in a buffer are streamed instead.
+    SampleBufferPtr buffer = DecodeSampleBuffer(source.get());
+    if (!buffer) {
+      return device->openStream(source.get());
+    }
+    return device->openSampleBuffer(buffer.get());
+  }
 
-    OutputStream* stream = device->openBuffer(
-      buffer, stream_length,
-      channel_count, sample_rate, sample_format);
 
-    delete[] buffer;
-    return stream;
+
+  ADR_EXPORT(void) AdrSetHybridSoundPolicy(
+    int threshold_bytes,
+    int head_milliseconds)
+  {
+    SYNCHRONIZED(s_policy_mutex);
+    s_hybrid_threshold = threshold_bytes;
+    s_hybrid_head      = std::max(0, head_milliseconds);
   }
 
 }
@@ -1,5 +1,8 @@
+#include <algorithm>
+#include <map>
 #include <vector>
 #include "internal.h"
+#include "threads.h"
 
 
 namespace audiere {
@@ -60,8 +63,44 @@ namespace audiere {
   };
 
 
+  class MultipleSoundEffect;
+
+
+  /**
+   * Hands the device's stop events to a MultipleSoundEffect.  The device
+   * owns the callback, so it refers to the effect weakly and is detached
+   * when the effect goes away.
+   */
+  class VoiceStopCallback : public RefImplementation<StopCallback> {
+  public:
+    VoiceStopCallback(MultipleSoundEffect* effect) {
+      m_effect = effect;
+    }
+
+    void detach() {
+      SYNCHRONIZED(m_mutex);
+      m_effect = 0;
+    }
+
+    void ADR_CALL streamStopped(StopEvent* event);
+
+  private:
+    Mutex m_mutex;
+    MultipleSoundEffect* m_effect;
+  };
+
+
+  /**
+   * Plays overlapping instances of a sample buffer on a bounded pool of
+   * output streams.  Stopped voices are put on a free list by the device's
+   * stop events, so play() reuses one without searching.  Playing voices
+   * are kept in a list in the order they started, which is what
+   * VOICE_STEAL_OLDEST takes from.
+   */
   class MultipleSoundEffect : public RefImplementation<SoundEffect> {
   public:
+    enum { DEFAULT_VOICE_LIMIT = 16 };
+
     MultipleSoundEffect(AudioDevice* device, SampleBuffer* sb) {
       m_device = device;
       m_buffer = sb;
@@ -69,37 +108,45 @@ namespace audiere {
       m_volume = 1;
       m_pan = 0;
       m_shift = 1;
+
+      m_voice_limit  = DEFAULT_VOICE_LIMIT;
+      m_voice_policy = VOICE_STEAL_OLDEST;
+      m_oldest = -1;
+      m_newest = -1;
+
+      m_callback = new VoiceStopCallback(this);
+      m_device->registerCallback(m_callback.get());
+    }
+
+    ~MultipleSoundEffect() {
+      m_callback->detach();
+      m_device->unregisterCallback(m_callback.get());
     }
 
     void ADR_CALL play() {
-      // go through the list and see if any streams are done playing
-      // so we can reuse them
-      for (unsigned i = 0; i < m_streams.size(); ++i) {
-        if (!m_streams[i]->isPlaying()) {
-          m_streams[i]->reset();
-          m_streams[i]->setVolume(m_volume);
-          m_streams[i]->setPan(m_pan);
-          m_streams[i]->setPitchShift(m_shift);
-          m_streams[i]->play();
-          return;
-        }
-      }
+      SYNCHRONIZED(m_mutex);
 
-      // open a new stream and play it
-      OutputStream* stream = m_device->openStream(m_buffer->openStream());
-      if (!stream) {
+      int v = acquireVoice();
+      if (v < 0) {
         return;
       }
+
+      OutputStream* stream = m_voices[v].stream.get();
+      stream->reset();
       stream->setVolume(m_volume);
       stream->setPan(m_pan);
       stream->setPitchShift(m_shift);
       stream->play();
-
-      m_streams.push_back(stream);
+      link(v);
     }
 
     void ADR_CALL stop() {
-      m_streams.clear();
+      SYNCHRONIZED(m_mutex);
+      m_voices.clear();
+      m_free.clear();
+      m_voice_index.clear();
+      m_oldest = -1;
+      m_newest = -1;
     }
 
     void ADR_CALL setVolume(float volume) {
@@ -125,11 +172,160 @@ namespace audiere {
     float ADR_CALL getPitchShift() {
       return m_shift;
     }
-    
+
+    void ADR_CALL setVoiceLimit(int limit) {
+      SYNCHRONIZED(m_mutex);
+      m_voice_limit = std::max(1, limit);
+    }
+
+    int ADR_CALL getVoiceLimit() {
+      SYNCHRONIZED(m_mutex);
+      return m_voice_limit;
+    }
+
+    void ADR_CALL setVoicePolicy(VoicePolicy policy) {
+      SYNCHRONIZED(m_mutex);
+      m_voice_policy = policy;
+    }
+
+    VoicePolicy ADR_CALL getVoicePolicy() {
+      SYNCHRONIZED(m_mutex);
+      return m_voice_policy;
+    }
+
+    /// Called on the device's event thread.
+    void voiceStopped(OutputStream* stream) {
+      SYNCHRONIZED(m_mutex);
+      std::map<OutputStream*, int>::iterator i = m_voice_index.find(stream);
+      if (i == m_voice_index.end()) {
+        return;
+      }
+
+      // The event may be stale if the voice was stolen and restarted.
+      int v = i->second;
+      if (m_voices[v].playing && !stream->isPlaying()) {
+        release(v);
+      }
+    }
+
+  private:
+    struct Voice {
+      OutputStreamPtr stream;
+      bool playing;  ///< whether the voice is in the playing list
+      int older;
+      int newer;
+    };
+
+    /// Returns a voice to play on, or -1.  Expects m_mutex.
+    int acquireVoice() {
+      if (m_free.empty() && !canOpenVoice()) {
+        // Stop events arrive asynchronously, so some voices may have
+        // finished without having been put on the free list yet.
+        reclaimVoices();
+      }
+
+      if (!m_free.empty()) {
+        int v = m_free.back();
+        m_free.pop_back();
+        return v;
+      }
+
+      if (canOpenVoice()) {
+        return openVoice();
+      }
+
+      if (m_voice_policy == VOICE_STEAL_OLDEST && m_oldest >= 0) {
+        int v = m_oldest;
+        unlink(v);
+        return v;
+      }
+      return -1;
+    }
+
+    bool canOpenVoice() {
+      return (int(m_voices.size()) < m_voice_limit ||
+              m_voice_policy == VOICE_GROW);
+    }
+
+    int openVoice() {
+      OutputStream* stream = m_device->openSampleBuffer(m_buffer.get());
+      if (!stream) {
+        return -1;
+      }
+
+      Voice voice;
+      voice.stream  = stream;
+      voice.playing = false;
+      voice.older   = -1;
+      voice.newer   = -1;
+      m_voices.push_back(voice);
+
+      int v = int(m_voices.size()) - 1;
+      m_voice_index[stream] = v;
+      return v;
+    }
+
+    void reclaimVoices() {
+      int v = m_oldest;
+      while (v >= 0) {
+        int next = m_voices[v].newer;
+        if (!m_voices[v].stream->isPlaying()) {
+          release(v);
+        }
+        v = next;
+      }
+    }
+
+    void release(int v) {
+      unlink(v);
+      m_free.push_back(v);
+    }
+
+    /// Appends a voice to the playing list as the newest.
+    void link(int v) {
+      Voice& voice = m_voices[v];
+      voice.playing = true;
+      voice.older   = m_newest;
+      voice.newer   = -1;
+      if (m_newest >= 0) {
+        m_voices[m_newest].newer = v;
+      } else {
+        m_oldest = v;
+      }
+      m_newest = v;
+    }
+
+    void unlink(int v) {
+      Voice& voice = m_voices[v];
+      if (voice.older >= 0) {
+        m_voices[voice.older].newer = voice.newer;
+      } else {
+        m_oldest = voice.newer;
+      }
+      if (voice.newer >= 0) {
+        m_voices[voice.newer].older = voice.older;
+      } else {
+        m_newest = voice.older;
+      }
+      voice.playing = false;
+      voice.older   = -1;
+      voice.newer   = -1;
+    }
+
   private:
     AudioDevicePtr m_device;
     SampleBufferPtr m_buffer;
-    std::vector<OutputStreamPtr> m_streams;
+    RefPtr<VoiceStopCallback> m_callback;
+
+    Mutex m_mutex;
+    std::vector<Voice> m_voices;
+    std::vector<int> m_free;
+    std::map<OutputStream*, int> m_voice_index;
+    int m_oldest;  ///< first voice in the playing list, or -1
+    int m_newest;  ///< last voice in the playing list, or -1
+
+    int m_voice_limit;
+    VoicePolicy m_voice_policy;
 
     float m_volume;
     float m_pan;
@@ -137,6 +333,15 @@ namespace audiere {
   };
 
 
+  void
+  VoiceStopCallback::streamStopped(StopEvent* event) {
+    SYNCHRONIZED(m_mutex);
+    if (m_effect) {
+      m_effect->voiceStopped(event->getOutputStream());
+    }
+  }
+
+
   ADR_EXPORT(SoundEffect*) AdrOpenSoundEffect(
     AudioDevice* device,
     SampleSource* source,
@@ -162,4 +367,28 @@ namespace audiere {
     }
   }
 
+
+  ADR_EXPORT(SoundEffect*) AdrOpenSoundEffectFromBuffer(
+    AudioDevice* device,
+    SampleBuffer* buffer,
+    SoundEffectType type)
+  {
+    if (!device || !buffer) {
+      return 0;
+    }
+
+    switch (type) {
+      case SINGLE: {
+        OutputStream* os = device->openSampleBuffer(buffer);
+        return (os ? new SingleSoundEffect(os) : 0);
+      }
+
+      case MULTIPLE:
+        return new MultipleSoundEffect(device, buffer);
+
+      default:
+        return 0;
+    }
+  }
+
 }
@@ -8,19 +8,90 @@
 #define THREADS_H
 
 
+#include <stddef.h>
 #include "debug.h"
+#include "types.h"
 
 
 namespace audiere {
 
   typedef void (*AI_ThreadRoutine)(void* opaque);
 
+  enum AI_SchedulingPolicy {
+    AI_SCHED_DEFAULT,  ///< priority is an offset from the default
+    AI_SCHED_FIFO,     ///< real-time, priority is absolute
+    AI_SCHED_RR,       ///< real-time round robin, priority is absolute
+  };
+
+  /// How the system should schedule a new thread.
+  struct AI_ThreadSchedule {
+    AI_ThreadSchedule() {
+      policy   = AI_SCHED_DEFAULT;
+      priority = 0;
+      cpu_mask = 0;
+    }
+
+    AI_SchedulingPolicy policy;
+    int priority;
+    u64 cpu_mask;  ///< processors the thread may run on, or 0 for any
+  };
+
   // threads
   bool AI_CreateThread(AI_ThreadRoutine routine, void* opaque, int priority = 0);
 
+  /**
+   * Creates a thread with the given scheduling.  If the system refuses
+   * the policy or the affinity, the reason is printed to stderr and no
+   * thread is created.
+   */
+  bool AI_CreateThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule);
+
+  /// A thread that has to be joined.
+  typedef struct AI_ThreadData* AI_Thread;
+
+  /**
+   * Like AI_CreateThread, but the thread isn't detached: AI_JoinThread
+   * must be called on it, and waits for routine to return.
+   *
+   * @return  the thread, or 0 if it couldn't be created
+   */
+  AI_Thread AI_CreateJoinableThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule);
+
+  // waits for the thread to finish and frees it
+  void AI_JoinThread(AI_Thread thread);
+
   // waiting
   void AI_Sleep(unsigned milliseconds);
 
+  // number of processors available to the process (at least 1)
+  int AI_GetProcessorCount();
+
+  // Keeps memory from being paged out, so touching it never faults.
+  // Failures are printed to stderr.
+  bool AI_LockMemory(const void* address, size_t size);
+
+  // Lets memory locked with AI_LockMemory be paged out again.
+  void AI_UnlockMemory(const void* address, size_t size);
+
+  // Locks the size bytes of the calling thread's stack below the caller.
+  // Returns where they start, for AI_UnlockMemory, or 0 on failure.
+  void* AI_LockStack(size_t size);
+
+  // Atomic operations for lock-free structures.  Loads acquire, stores
+  // release, and the read-modify-writes are full barriers.
+  // CompareExchange stores exchange if var is comparand, and returns
+  // what var was either way.
+  long AI_AtomicLoad(const volatile long& var);
+  void AI_AtomicStore(volatile long& var, long value);
+  long AI_AtomicExchange(volatile long& var, long value);
+  long AI_AtomicCompareExchange(volatile long& var, long exchange, long comparand);
+
 
   class Mutex {
   public:
@@ -43,6 +114,7 @@ namespace audiere {
     CondVar();
     ~CondVar();
 
+    void wait(Mutex& mutex);
     void wait(Mutex& mutex, float seconds);
     void notify();
 
@@ -52,6 +124,39 @@ namespace audiere {
   };
 
 
+  /**
+   * A wakeup one thread waits for and any thread raises, without locks
+   * or allocation.  Raising it again before the waiter wakes wakes it
+   * once.  Where the system has one, it is backed by a descriptor that
+   * polls readable while the signal is raised.
+   */
+  class Signal {
+  public:
+    Signal();
+    ~Signal();
+
+    void raise();
+
+    /**
+     * Waits until the signal is raised, forever if milliseconds is
+     * negative, and lowers it.
+     *
+     * @return  whether the signal was raised
+     */
+    bool wait(int milliseconds = -1);
+
+    /// Lowers the signal if it is raised.
+    void clear();
+
+    /// Returns the pollable descriptor, or -1 if there is none.
+    int getDescriptor();
+
+  private:
+    struct Impl;
+    Impl* m_impl;
+  };
+
+
   class ScopedLock {
   public:
     ScopedLock(Mutex& mutex): m_mutex(mutex) {
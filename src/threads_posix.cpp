@@ -1,7 +1,18 @@
+#include <alloca.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/mman.h>
 #include <sys/time.h>
+#ifdef __linux__
+  #include <sys/eventfd.h>
+#endif
 #include "threads.h"
 #include "utility.h"
 
@@ -22,7 +33,96 @@ namespace audiere {
   }
 
 
+  /// pthread calls return their error instead of setting errno.
+  static void ReportError(const char* what, int error) {
+    ADR_LOG(what);
+    fprintf(stderr, "%s: %s\n", what, strerror(error));
+  }
+
+
+  static bool SetSchedule(pthread_attr_t* attr, const AI_ThreadSchedule& schedule) {
+    if (schedule.policy == AI_SCHED_DEFAULT) {
+      // get default scheduling policy
+      int policy;
+      if (pthread_attr_getschedpolicy(attr, &policy)) {
+        return false;
+      }
+
+      int min_prio = sched_get_priority_min(policy);
+      int max_prio = sched_get_priority_max(policy);
+
+      // get default scheduling parameters
+      sched_param sched;
+      if (pthread_attr_getschedparam(attr, &sched)) {
+        return false;
+      }
+
+      // treat the specified priority as an offset from the default one
+      sched.sched_priority = clamp(
+          min_prio,
+          sched.sched_priority + schedule.priority,
+          max_prio);
+
+      if (pthread_attr_setschedparam(attr, &sched)) {
+        return false;
+      }
+    } else {
+      int policy = (schedule.policy == AI_SCHED_FIFO ? SCHED_FIFO : SCHED_RR);
+
+      sched_param sched;
+      sched.sched_priority = clamp(
+          sched_get_priority_min(policy),
+          schedule.priority,
+          sched_get_priority_max(policy));
+
+      // without PTHREAD_EXPLICIT_SCHED, the creator's scheduling is used
+      int error;
+      if ((error = pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED)) ||
+          (error = pthread_attr_setschedpolicy(attr, policy)) ||
+          (error = pthread_attr_setschedparam(attr, &sched)))
+      {
+        ReportError("real-time scheduling", error);
+        return false;
+      }
+    }
+
+    if (schedule.cpu_mask) {
+#ifdef CPU_SET
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      for (int i = 0; i < 64 && i < CPU_SETSIZE; ++i) {
+        if (schedule.cpu_mask & (u64(1) << i)) {
+          CPU_SET(i, &cpus);
+        }
+      }
+      int error = pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+      if (error) {
+        ReportError("CPU affinity", error);
+        return false;
+      }
+#else
+      ReportError("CPU affinity", ENOSYS);
+      return false;
+#endif
+    }
+
+    return true;
+  }
+
+
   bool AI_CreateThread(AI_ThreadRoutine routine, void* opaque, int priority) {
+    AI_ThreadSchedule schedule;
+    schedule.priority = priority;
+    return AI_CreateThread(routine, opaque, schedule);
+  }
+
+
+  static bool StartThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule,
+    pthread_t& thread)
+  {
     ThreadInternal* ti = new ThreadInternal;
     ti->routine = routine;
     ti->opaque  = opaque;
@@ -33,40 +133,19 @@ namespace audiere {
       return false;
     }
 
-    // get default scheduling policy
-    int policy;
-    if (pthread_attr_getschedpolicy(&attr, &policy)) {
+    if (!SetSchedule(&attr, schedule)) {
       pthread_attr_destroy(&attr);
       delete ti;
       return false;
     }
 
-    int min_prio = sched_get_priority_min(policy);
-    int max_prio = sched_get_priority_max(policy);
-
-    // get default scheduling parameters
-    sched_param sched;
-    if (pthread_attr_getschedparam(&attr, &sched)) {
-        pthread_attr_destroy(&attr);
-        delete ti;
-        return false;
-    }
-
-    // treat the specified priority as an offset from the default one
-    sched.sched_priority = clamp(
-        min_prio,
-        sched.sched_priority + priority,
-        max_prio);
-
-    if (pthread_attr_setschedparam(&attr, &sched)) {
-        pthread_attr_destroy(&attr);
-        delete ti;
-        return false;
-    }
-
-    pthread_t thread;
+    // Real-time policies are only checked against the caller's
+    // privileges here, e.g. EPERM without CAP_SYS_NICE or RLIMIT_RTPRIO.
     int result = pthread_create(&thread, &attr, ThreadRoutine, ti);
     if (result != 0) {
+      if (schedule.policy != AI_SCHED_DEFAULT || schedule.cpu_mask) {
+        ReportError("pthread_create", result);
+      }
       pthread_attr_destroy(&attr);
       delete ti;
       return false;
@@ -77,6 +156,46 @@ namespace audiere {
   }
 
 
+  bool AI_CreateThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule)
+  {
+    pthread_t thread;
+    if (!StartThread(routine, opaque, schedule, thread)) {
+      return false;
+    }
+    pthread_detach(thread);
+    return true;
+  }
+
+
+  struct AI_ThreadData {
+    pthread_t thread;
+  };
+
+
+  AI_Thread AI_CreateJoinableThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule)
+  {
+    pthread_t thread;
+    if (!StartThread(routine, opaque, schedule, thread)) {
+      return 0;
+    }
+    AI_ThreadData* data = new AI_ThreadData;
+    data->thread = thread;
+    return data;
+  }
+
+
+  void AI_JoinThread(AI_Thread thread) {
+    pthread_join(thread->thread, 0);
+    delete thread;
+  }
+
+
   void AI_Sleep(unsigned milliseconds) {
     int seconds = milliseconds / 1000;
     int useconds = (milliseconds % 1000) * 1000;
@@ -86,6 +205,59 @@ namespace audiere {
   }
 
 
+  int AI_GetProcessorCount() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0) {
+      return int(count);
+    }
+#endif
+    return 1;
+  }
+
+
+  bool AI_LockMemory(const void* address, size_t size) {
+    if (mlock(address, size)) {
+      perror("mlock");
+      return false;
+    }
+    return true;
+  }
+
+
+  void AI_UnlockMemory(const void* address, size_t size) {
+    munlock(address, size);
+  }
+
+
+  void* AI_LockStack(size_t size) {
+    // touch the pages so they are there to lock
+    char* stack = (char*)alloca(size);
+    memset(stack, 0, size);
+    return (AI_LockMemory(stack, size) ? stack : 0);
+  }
+
+
+  long AI_AtomicLoad(const volatile long& var) {
+    return __atomic_load_n(&var, __ATOMIC_ACQUIRE);
+  }
+
+
+  void AI_AtomicStore(volatile long& var, long value) {
+    __atomic_store_n(&var, value, __ATOMIC_RELEASE);
+  }
+
+
+  long AI_AtomicExchange(volatile long& var, long value) {
+    return __atomic_exchange_n(&var, value, __ATOMIC_SEQ_CST);
+  }
+
+
+  long AI_AtomicCompareExchange(volatile long& var, long exchange, long comparand) {
+    return __sync_val_compare_and_swap(&var, comparand, exchange);
+  }
+
+
   struct Mutex::Impl {
     pthread_mutex_t mutex;
   };
@@ -135,12 +307,16 @@ namespace audiere {
     delete m_impl;
   }
 
+  void CondVar::wait(Mutex& mutex) {
+    pthread_cond_wait(&m_impl->cond, &mutex.m_impl->mutex);
+  }
+
   void CondVar::wait(Mutex& mutex, float seconds) {
     double ds = seconds;  // May need greater than float precision.
     
     timeval tv;
     gettimeofday(&tv, 0);
-    ds += tv.tv_sec + tv.tv_usec / 1000000000.0;
+    ds += tv.tv_sec + tv.tv_usec / 1000000.0;
     
     timespec ts;
     ts.tv_sec  = int(ds);
@@ -152,4 +328,82 @@ namespace audiere {
     pthread_cond_signal(&m_impl->cond);
   }
 
+
+
+  // Linux has eventfd, other systems get a pipe.  Either way, writes
+  // to a full descriptor fail harmlessly, since it's readable already.
+
+  struct Signal::Impl {
+    int read_fd;
+    int write_fd;
+  };
+
+  Signal::Signal() {
+    m_impl = new Impl;
+#ifdef __linux__
+    m_impl->read_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_impl->write_fd = m_impl->read_fd;
+    if (m_impl->read_fd < 0) {
+#else
+    int fds[2];
+    if (pipe(fds) == 0) {
+      for (int i = 0; i < 2; ++i) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+      }
+      m_impl->read_fd  = fds[0];
+      m_impl->write_fd = fds[1];
+    } else {
+#endif
+      ADR_LOG("creating the signal descriptor failed in Signal::Signal()");
+      abort();
+    }
+  }
+
+  Signal::~Signal() {
+    close(m_impl->read_fd);
+    if (m_impl->write_fd != m_impl->read_fd) {
+      close(m_impl->write_fd);
+    }
+    delete m_impl;
+  }
+
+  void Signal::raise() {
+#ifdef __linux__
+    u64 one = 1;
+    ssize_t result = write(m_impl->write_fd, &one, sizeof(one));
+#else
+    char one = 1;
+    ssize_t result = write(m_impl->write_fd, &one, sizeof(one));
+#endif
+    (void)result;
+  }
+
+  bool Signal::wait(int milliseconds) {
+    pollfd fd;
+    fd.fd = m_impl->read_fd;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    int result;
+    do {
+      result = poll(&fd, 1, milliseconds);
+    } while (result < 0 && errno == EINTR);
+    if (result <= 0) {
+      return false;
+    }
+    clear();
+    return true;
+  }
+
+  void Signal::clear() {
+    // eventfd is emptied by one read, a pipe may take several
+    char buffer[64];
+    while (read(m_impl->read_fd, buffer, sizeof(buffer)) > 0) {
+    }
+  }
+
+  int Signal::getDescriptor() {
+    return m_impl->read_fd;
+  }
+
 }
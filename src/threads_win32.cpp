@@ -1,5 +1,8 @@
 #include <windows.h>
+#include <malloc.h>
 #include <process.h>
+#include <stdio.h>
+#include <string.h>
 #include <cstdlib>
 #include "threads.h"
 
@@ -9,6 +12,7 @@ namespace audiere {
   struct ThreadInternal {
     AI_ThreadRoutine routine;
     void*            opaque;
+    bool             cancelled;  ///< exit without calling routine
   };
 
   static unsigned WINAPI InternalThreadRoutine(void* opaque);
@@ -47,26 +51,107 @@ namespace audiere {
   }
 
 
+  static void ReportError(const char* what) {
+    ADR_LOG(what);
+    fprintf(stderr, "%s failed with error %lu\n", what, GetLastError());
+  }
+
+
   bool AI_CreateThread(AI_ThreadRoutine routine, void* opaque, int priority) {
+    AI_ThreadSchedule schedule;
+    schedule.priority = priority;
+    return AI_CreateThread(routine, opaque, schedule);
+  }
+
+
+  /// Returns the thread's handle, or 0 if it couldn't be created.
+  static HANDLE StartThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule)
+  {
     // create internal thread data
     ThreadInternal* internal = new ThreadInternal;
-    internal->routine  = routine;
-    internal->opaque   = opaque;
+    internal->routine   = routine;
+    internal->opaque    = opaque;
+    internal->cancelled = false;
     
     // create the actual thread
     unsigned threadid;
     HANDLE handle = (HANDLE)_beginthreadex(
       0, 0, InternalThreadRoutine, internal, CREATE_SUSPENDED, &threadid);
-    if (handle) {
-      if (SupportsThreadPriority()) {
-        SetThreadPriority(handle, GetWin32Priority(priority));
+    if (!handle) {
+      delete internal;
+      return 0;
+    }
+
+    bool result = true;
+    if (schedule.policy != AI_SCHED_DEFAULT) {
+      // the closest Windows has to a real-time policy
+      if (!SetThreadPriority(handle, THREAD_PRIORITY_TIME_CRITICAL)) {
+        ReportError("SetThreadPriority");
+        result = false;
+      }
+    } else if (SupportsThreadPriority()) {
+      SetThreadPriority(handle, GetWin32Priority(schedule.priority));
+    }
+
+    if (result && schedule.cpu_mask) {
+      if (!SetThreadAffinityMask(handle, DWORD_PTR(schedule.cpu_mask))) {
+        ReportError("SetThreadAffinityMask");
+        result = false;
       }
-      ResumeThread(handle);
+    }
+
+    // a refused thread still has to run to exit and free internal
+    internal->cancelled = !result;
+    ResumeThread(handle);
+    if (!result) {
       CloseHandle(handle);
-      return true;
-    } else {
+      return 0;
+    }
+    return handle;
+  }
+
+
+  bool AI_CreateThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule)
+  {
+    HANDLE handle = StartThread(routine, opaque, schedule);
+    if (!handle) {
       return false;
     }
+    CloseHandle(handle);
+    return true;
+  }
+
+
+  struct AI_ThreadData {
+    HANDLE handle;
+  };
+
+
+  AI_Thread AI_CreateJoinableThread(
+    AI_ThreadRoutine routine,
+    void* opaque,
+    const AI_ThreadSchedule& schedule)
+  {
+    HANDLE handle = StartThread(routine, opaque, schedule);
+    if (!handle) {
+      return 0;
+    }
+    AI_ThreadData* data = new AI_ThreadData;
+    data->handle = handle;
+    return data;
+  }
+
+
+  void AI_JoinThread(AI_Thread thread) {
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    delete thread;
   }
 
 
@@ -74,7 +159,9 @@ namespace audiere {
     ThreadInternal* internal = static_cast<ThreadInternal*>(opaque);
 
     // call the function passed 
-    internal->routine(internal->opaque);
+    if (!internal->cancelled) {
+      internal->routine(internal->opaque);
+    }
     delete internal;
     return 0;
   }
@@ -85,6 +172,57 @@ namespace audiere {
   }
 
 
+  int AI_GetProcessorCount() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (info.dwNumberOfProcessors > 0 ? int(info.dwNumberOfProcessors) : 1);
+  }
+
+
+  bool AI_LockMemory(const void* address, size_t size) {
+    if (!VirtualLock(const_cast<void*>(address), size)) {
+      ReportError("VirtualLock");
+      return false;
+    }
+    return true;
+  }
+
+
+  void AI_UnlockMemory(const void* address, size_t size) {
+    VirtualUnlock(const_cast<void*>(address), size);
+  }
+
+
+  void* AI_LockStack(size_t size) {
+    // touch the pages so they are there to lock
+    char* stack = (char*)_alloca(size);
+    memset(stack, 0, size);
+    return (AI_LockMemory(stack, size) ? stack : 0);
+  }
+
+
+  long AI_AtomicLoad(const volatile long& var) {
+    // volatile reads acquire with Microsoft's compilers
+    return var;
+  }
+
+
+  void AI_AtomicStore(volatile long& var, long value) {
+    // and volatile writes release
+    var = value;
+  }
+
+
+  long AI_AtomicExchange(volatile long& var, long value) {
+    return InterlockedExchange(&var, value);
+  }
+
+
+  long AI_AtomicCompareExchange(volatile long& var, long exchange, long comparand) {
+    return InterlockedCompareExchange(&var, exchange, comparand);
+  }
+
+
   struct Mutex::Impl {
     CRITICAL_SECTION cs;
   };
@@ -131,6 +269,12 @@ namespace audiere {
     delete m_impl;
   }
 
+  void CondVar::wait(Mutex& mutex) {
+    mutex.unlock();
+    WaitForSingleObject(m_impl->event, INFINITE);
+    mutex.lock();
+  }
+
   void CondVar::wait(Mutex& mutex, float seconds) {
     mutex.unlock();
     WaitForSingleObject(m_impl->event, int(seconds * 1000));
@@ -141,4 +285,42 @@ namespace audiere {
     SetEvent(m_impl->event);
   }
 
+
+
+  struct Signal::Impl {
+    HANDLE event;
+  };
+
+  Signal::Signal() {
+    m_impl = new Impl;
+    m_impl->event = CreateEvent(0, FALSE, FALSE, 0);
+    if (!m_impl->event) {
+      ADR_LOG("CreateEvent() failed in Signal::Signal()");
+      abort();
+    }
+  }
+
+  Signal::~Signal() {
+    CloseHandle(m_impl->event);
+    delete m_impl;
+  }
+
+  void Signal::raise() {
+    SetEvent(m_impl->event);
+  }
+
+  bool Signal::wait(int milliseconds) {
+    // auto-reset, so waking lowers it
+    DWORD timeout = (milliseconds < 0 ? INFINITE : DWORD(milliseconds));
+    return (WaitForSingleObject(m_impl->event, timeout) == WAIT_OBJECT_0);
+  }
+
+  void Signal::clear() {
+    ResetEvent(m_impl->event);
+  }
+
+  int Signal::getDescriptor() {
+    return -1;
+  }
+
 }
@@ -17,6 +17,14 @@ namespace audiere {
   /// Return current time in microseconds.
   u64 GetNow();
 
+  /// Return microseconds on a clock that never jumps, e.g. when the
+  /// system time is set.  Only differences between values mean anything.
+  u64 GetMonotonicNow();
+
+  /// Return the CPU time the calling thread has used in microseconds,
+  /// or 0 if the system can't tell.
+  u64 GetThreadCpuTime();
+
 }
 
 
@@ -23,4 +23,26 @@ namespace audiere {
     return u64(tv.tv_sec) * 1000000 + tv.tv_usec;
   }
 
+
+  u64 GetMonotonicNow() {
+#ifdef CLOCK_MONOTONIC
+    struct timespec tp;
+    if (clock_gettime(CLOCK_MONOTONIC, &tp) == 0) {
+      return u64(tp.tv_sec) * 1000000 + u64(tp.tv_nsec) / 1000;
+    }
+#endif
+    return GetNow();
+  }
+
+
+  u64 GetThreadCpuTime() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec tp;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &tp) == 0) {
+      return u64(tp.tv_sec) * 1000000 + u64(tp.tv_nsec) / 1000;
+    }
+#endif
+    return 0;
+  }
+
 }
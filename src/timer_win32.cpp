@@ -19,4 +19,22 @@ namespace audiere {
     return timeGetTime() * 1000;
   }
 
+
+  u64 GetMonotonicNow() {
+    // neither the performance counter nor timeGetTime follow the clock
+    return GetNow();
+  }
+
+
+  u64 GetThreadCpuTime() {
+    FILETIME creation, exit, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+      return 0;
+    }
+    // FILETIMEs count 100 nanosecond intervals
+    u64 k = (u64(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime;
+    u64 u = (u64(user.dwHighDateTime) << 32) | user.dwLowDateTime;
+    return (k + u) / 10;
+  }
+
 }
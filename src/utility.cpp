@@ -73,6 +73,15 @@ namespace audiere {
   }
 
 
+  int getNextPowerOfTwo(int value) {
+    int i = 1;
+    while (i < value) {
+      i *= 2;
+    }
+    return i;
+  }
+
+
   int strcmp_case(const char* a, const char* b) {
     while (*a && *b) {
 
@@ -104,11 +113,19 @@ namespace audiere {
 #else
 
   ADR_EXPORT(long) AdrAtomicIncrement(volatile long& var) {
+#ifdef __GNUC__
+    return __sync_add_and_fetch(&var, 1);
+#else
     return ++var;
+#endif
   }
 
   ADR_EXPORT(long) AdrAtomicDecrement(volatile long& var) {
+#ifdef __GNUC__
+    return __sync_sub_and_fetch(&var, 1);
+#else
     return --var;
+#endif
   }
 
 #endif
@@ -7,6 +7,7 @@
 #endif
 
 
+#include <limits.h>
 #include <algorithm>
 #include <map>
 #include <string>
@@ -115,15 +116,27 @@ namespace audiere {
   }
 
 
-  inline int GetFileLength(File* file) {
-    int pos = file->tell();
-    file->seek(0, File::END);
-    int length = file->tell();
-    file->seek(pos, File::BEGIN);
+  inline s64 GetFileLength(File* file) {
+    s64 pos = file->tell64();
+    file->seek64(0, File::END);
+    s64 length = file->tell64();
+    file->seek64(pos, File::BEGIN);
     return length;
   }
 
 
+  /// Narrows a 64-bit length or position for the int compatibility API.
+  inline int ClampToInt(s64 value) {
+    if (value > INT_MAX) {
+      return INT_MAX;
+    } else if (value < INT_MIN) {
+      return INT_MIN;
+    } else {
+      return int(value);
+    }
+  }
+
+
   inline SampleSource* OpenBufferStream(
     void* samples, int sample_count,
     int channel_count, int sample_rate, SampleFormat sample_format)
@@ -134,58 +147,135 @@ namespace audiere {
   }
 
 
-  class QueueBuffer {
-  public:
-    QueueBuffer() {
-      m_capacity = 256;
-      m_size = 0;
+  /// Returns the smallest power of two that is greater than or equal to value.
+  int getNextPowerOfTwo(int value);
+
 
+  /**
+   * A FIFO of bytes stored in a power-of-two ring.  Reads and writes wrap
+   * around the end of the storage, so queued data is never moved.  The
+   * capacity only changes when a single write does not fit, which callers
+   * avoid by sizing the ring for their largest write up front.
+   *
+   * peek()/consume() and getWriteSpan()/commit() expose the storage
+   * directly so callers can decode into or convert out of the ring without
+   * an intermediate copy.
+   */
+  class RingBuffer {
+  public:
+    RingBuffer(int capacity = 4096) {
+      m_capacity = getNextPowerOfTwo(std::max(capacity, 16));
       m_buffer = (u8*)malloc(m_capacity);
+      m_read = 0;
+      m_write = 0;
+    }
+
+    ~RingBuffer() {
+      free(m_buffer);
     }
 
-    ~QueueBuffer() {
-      m_buffer = (u8*)realloc(m_buffer, 0);
+    /// Number of bytes queued.
+    int getSize() const {
+      return int(m_write - m_read);
     }
 
-    int getSize() {
-      return m_size;
+    int getCapacity() const {
+      return m_capacity;
     }
 
     void write(const void* buffer, int size) {
-      bool need_realloc = false;
-      while (size + m_size > m_capacity) {
-        m_capacity *= 2;
-        need_realloc = true;
+      if (getSize() + size > m_capacity) {
+        grow(getSize() + size);
       }
 
-      if (need_realloc) {
-        m_buffer = (u8*)realloc(m_buffer, m_capacity);
+      const u8* in = (const u8*)buffer;
+      while (size > 0) {
+        void* span;
+        int to_write = std::min(size, getWriteSpan(span));
+        memcpy(span, in, to_write);
+        commit(to_write);
+        in += to_write;
+        size -= to_write;
       }
-
-      memcpy(m_buffer + m_size, buffer, size);
-      m_size += size;
     }
 
     int read(void* buffer, int size) {
-      int to_read = std::min(size, m_size);
-      memcpy(buffer, m_buffer, to_read);
-      memmove(m_buffer, m_buffer + to_read, m_size - to_read);
-      m_size -= to_read;
-      return to_read;
+      u8* out = (u8*)buffer;
+      int total = 0;
+      while (total < size) {
+        const void* span;
+        int to_read = std::min(size - total, peek(span));
+        if (to_read == 0) {
+          break;
+        }
+        memcpy(out + total, span, to_read);
+        consume(to_read);
+        total += to_read;
+      }
+      return total;
+    }
+
+    /**
+     * Points data at the oldest queued byte and returns how many bytes can
+     * be read from there contiguously.  This may be less than getSize()
+     * when the queued data wraps around the end of the ring.
+     */
+    int peek(const void*& data) const {
+      const int offset = int(m_read & (m_capacity - 1));
+      data = m_buffer + offset;
+      return std::min(getSize(), m_capacity - offset);
+    }
+
+    /// Drops size bytes from the front of the queue, as if they were read.
+    void consume(int size) {
+      m_read += std::min(size, getSize());
+    }
+
+    /**
+     * Points data at the first free byte and returns how many bytes can be
+     * written there contiguously.  Call commit() to queue what was written.
+     */
+    int getWriteSpan(void*& data) {
+      const int offset = int(m_write & (m_capacity - 1));
+      data = m_buffer + offset;
+      return std::min(m_capacity - getSize(), m_capacity - offset);
+    }
+
+    /// Queues size bytes previously written through getWriteSpan().
+    void commit(int size) {
+      m_write += size;
     }
 
     void clear() {
-      m_size = 0;
+      m_read = 0;
+      m_write = 0;
     }
 
   private:
+    void grow(int min_capacity) {
+      const int size = getSize();
+      const int capacity = getNextPowerOfTwo(min_capacity);
+      u8* buffer = (u8*)malloc(capacity);
+      read(buffer, size);
+      free(m_buffer);
+
+      m_buffer = buffer;
+      m_capacity = capacity;
+      m_read = 0;
+      m_write = size;
+    }
+
     u8* m_buffer;
     int m_capacity;
-    int m_size;
+
+    // free-running byte counters; only their difference and their low bits
+    // (masked by m_capacity - 1) are meaningful
+    unsigned m_read;
+    unsigned m_write;
 
     // private and unimplemented to prevent their use
-    QueueBuffer(const QueueBuffer&);
-    QueueBuffer& operator=(const QueueBuffer&);
+    RingBuffer(const RingBuffer&);
+    RingBuffer& operator=(const RingBuffer&);
   };
 
 
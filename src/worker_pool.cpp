@@ -0,0 +1,112 @@
+#include <algorithm>
+#include "debug.h"
+#include "utility.h"
+#include "worker_pool.h"
+
+
+namespace audiere {
+
+  static Mutex s_pool_mutex;
+  static WorkerPool* s_pool = 0;
+
+
+  WorkerPool& WorkerPool::get() {
+    SYNCHRONIZED(s_pool_mutex);
+    if (!s_pool) {
+      // leave a processor for the application and the audio device
+      int count = clamp(1, AI_GetProcessorCount() - 1, 4);
+      s_pool = new WorkerPool(count);
+    }
+    return *s_pool;
+  }
+
+
+  WorkerPool::WorkerPool(int thread_count) {
+    ADR_GUARD("WorkerPool::WorkerPool");
+
+    m_thread_count = 0;
+    for (int i = 0; i < thread_count; ++i) {
+      if (AI_CreateThread(threadRoutine, this)) {
+        ++m_thread_count;
+      } else {
+        ADR_LOG("THREAD CREATION FAILED");
+      }
+    }
+  }
+
+
+  void WorkerPool::submit(WorkerJob* job) {
+    submit(&job, 1);
+  }
+
+
+  void WorkerPool::submit(WorkerJob** jobs, int count) {
+    if (m_thread_count == 0) {
+      // nothing would ever take the jobs off the queue
+      for (int i = 0; i < count; ++i) {
+        WorkerJobPtr job = jobs[i];
+        job->run();
+      }
+      return;
+    }
+
+    m_mutex.lock();
+    for (int i = 0; i < count; ++i) {
+      m_jobs.push_back(jobs[i]);
+    }
+    m_mutex.unlock();
+
+    // a woken thread wakes the next one if jobs remain
+    m_jobs_available.notify();
+  }
+
+
+  bool WorkerPool::remove(WorkerJob* job) {
+    // let the job go after the lock is released, its destructor may be
+    // arbitrarily expensive
+    WorkerJobPtr removed;
+
+    SYNCHRONIZED(m_mutex);
+    std::deque<WorkerJobPtr>::iterator i =
+      std::find(m_jobs.begin(), m_jobs.end(), WorkerJobPtr(job));
+    if (i == m_jobs.end()) {
+      return false;
+    }
+    removed = *i;
+    m_jobs.erase(i);
+    return true;
+  }
+
+
+  int WorkerPool::getThreadCount() const {
+    return m_thread_count;
+  }
+
+
+  void WorkerPool::threadRoutine(void* arg) {
+    ADR_GUARD("WorkerPool::threadRoutine");
+    WorkerPool* This = static_cast<WorkerPool*>(arg);
+    This->run();
+  }
+
+
+  void WorkerPool::run() {
+    for (;;) {
+      m_mutex.lock();
+      while (m_jobs.empty()) {
+        m_jobs_available.wait(m_mutex);
+      }
+      WorkerJobPtr job = m_jobs.front();
+      m_jobs.pop_front();
+      bool more = !m_jobs.empty();
+      m_mutex.unlock();
+
+      if (more) {
+        m_jobs_available.notify();
+      }
+
+      job->run();
+    }
+  }
+
+}
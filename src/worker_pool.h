@@ -0,0 +1,65 @@
+/**
+ * @file
+ *
+ * Library-managed pool of background threads
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+
+#include <deque>
+#include "audiere.h"
+#include "threads.h"
+
+
+namespace audiere {
+
+  /// A unit of work that runs on one of the pool's threads.
+  class WorkerJob : public RefImplementation<RefCounted> {
+  public:
+    virtual void run() = 0;
+  };
+  typedef RefPtr<WorkerJob> WorkerJobPtr;
+
+
+  /**
+   * A fixed set of detached threads that run queued jobs in submission
+   * order.  The pool is created on first use and lives for the rest of the
+   * process.  If no thread could be started, jobs run inside submit().
+   */
+  class WorkerPool {
+  public:
+    /// Returns the pool shared by the whole library.
+    static WorkerPool& get();
+
+    void submit(WorkerJob* job);
+
+    /// Queues several jobs at once, waking as many threads as needed.
+    void submit(WorkerJob** jobs, int count);
+
+    /**
+     * Removes a job from the queue if it has not started running yet.
+     *
+     * @return  true if the job was removed and will never run
+     */
+    bool remove(WorkerJob* job);
+
+    int getThreadCount() const;
+
+  private:
+    WorkerPool(int thread_count);
+
+    static void threadRoutine(void* arg);
+    void run();
+
+    Mutex m_mutex;
+    CondVar m_jobs_available;
+    std::deque<WorkerJobPtr> m_jobs;
+    int m_thread_count;
+  };
+
+}
+
+
+#endif
@@ -0,0 +1,53 @@
+#include <iostream>
+#include <stdlib.h>
+#include "audiere.h"
+using namespace std;
+using namespace audiere;
+
+
+// Opens and closes a device over and over, with a stream playing on
+// each, and reports how long a cycle and the slowest close took.
+int main(int argc, const char** argv) {
+  const char* device_name = "";
+  if (argc >= 2) {
+    device_name = argv[1];
+  }
+  int count = 1000;
+  if (argc >= 3) {
+    count = atoi(argv[2]);
+  }
+
+  u64 slowest_close = 0;
+  const u64 start = GetMonotonicTime();
+  for (int i = 0; i < count; ++i) {
+    AudioDevicePtr device(OpenDevice(device_name));
+    if (!device) {
+      cerr << "OpenDevice() failed" << endl;
+      return EXIT_FAILURE;
+    }
+
+    OutputStreamPtr tone(device->openStream(CreateTone(440)));
+    if (!tone) {
+      cerr << "openStream() failed" << endl;
+      return EXIT_FAILURE;
+    }
+    tone->play();
+    tone = 0;
+
+    const u64 close_start = GetMonotonicTime();
+    device = 0;
+    const u64 close_time = GetMonotonicTime() - close_start;
+    if (close_time > slowest_close) {
+      slowest_close = close_time;
+    }
+  }
+  const u64 total = GetMonotonicTime() - start;
+
+  cout << count << " open/close cycles took "
+       << total / 1000 << " ms" << endl;
+  cout << "That is " << double(total) / count / 1000
+       << " ms per cycle, the slowest close took "
+       << double(slowest_close) / 1000 << " ms." << endl;
+
+  return EXIT_SUCCESS;
+}